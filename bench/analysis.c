@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "build.h"
+
+#include "analysis/scope.h"
+#include "analysis/cfg.h"
+#include "analysis/schedule.h"
+#include "analysis/manager.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <overture/mem.h>
+
+#include <stdlib.h>
+
+BENCH(schedule_large_func) {
+    size_t block_count = bench_size(bench, 10000);
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node* func = build_block_chain(mod, block_count, 100);
+    fir_mod_cleanup(mod);
+    fir_mod_compact_ids(mod);
+
+    bench_start(bench);
+    struct scope scope = scope_create(func);
+    bench_stop(bench, "scope", scope.members.elem_count);
+
+    bench_start(bench);
+    struct cfg cfg = cfg_create(&scope);
+    bench_stop(bench, "cfg", cfg.graph.node_count);
+
+    bench_start(bench);
+    struct schedule schedule = schedule_create(&cfg);
+    struct node_vec* block_contents = xmalloc(sizeof(struct node_vec) * cfg.graph.node_count);
+    for (size_t i = 0; i < cfg.graph.node_count; ++i)
+        block_contents[i] = node_vec_create();
+    schedule_list_block_contents(&schedule, block_contents);
+    bench_stop(bench, "schedule", scope.members.elem_count);
+
+    for (size_t i = 0; i < cfg.graph.node_count; ++i)
+        node_vec_destroy(&block_contents[i]);
+    free(block_contents);
+    schedule_destroy(&schedule);
+    cfg_destroy(&cfg);
+    scope_destroy(&scope);
+    fir_mod_destroy(mod);
+}
+
+BENCH(analysis_manager) {
+    size_t func_count = bench_size(bench, 10000);
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node** funcs = xmalloc(sizeof(struct fir_node*) * func_count);
+    for (size_t i = 0; i < func_count; ++i) {
+        funcs[i] = build_iter_pow(mod);
+        fir_node_make_external(funcs[i]);
+    }
+    struct analysis_manager* manager = analysis_manager_create(mod);
+
+    bench_start(bench);
+    for (size_t i = 0; i < func_count; ++i)
+        analysis_manager_schedule(manager, funcs[i]);
+    bench_stop(bench, "first pass", func_count);
+
+    // A pass that only touches one function should only cause that function to be analysed again.
+    fir_node_set_op(funcs[0], 0, funcs[0]->ops[0]);
+    bench_start(bench);
+    for (size_t i = 0; i < func_count; ++i)
+        analysis_manager_schedule(manager, funcs[i]);
+    bench_stop(bench, "second pass", func_count);
+
+    analysis_manager_destroy(manager);
+    free(funcs);
+    fir_mod_destroy(mod);
+}
@@ -0,0 +1,77 @@
+#include "bench.h"
+
+#include <overture/vec.h>
+
+#include <string.h>
+
+struct registered_bench {
+    const char* name;
+    bench_func func;
+    bool is_enabled;
+};
+
+VEC_DEFINE(bench_vec, struct registered_bench, PRIVATE)
+
+static struct bench_vec benches;
+static FILE* bench_output;
+
+void register_bench(const char* name, bench_func func) {
+    bench_vec_push(&benches, &(struct registered_bench) { .name = name, .func = func, .is_enabled = true });
+}
+
+void print_benches(FILE* file) {
+    VEC_FOREACH(struct registered_bench, registered_bench, benches) {
+        fprintf(file, "%s\n", registered_bench->name);
+    }
+}
+
+void filter_benches(int argc, char** argv) {
+    bool has_filter = false;
+    for (int i = 1; i < argc; ++i)
+        has_filter |= argv[i] != NULL;
+    if (!has_filter)
+        return;
+
+    VEC_FOREACH(struct registered_bench, registered_bench, benches) {
+        registered_bench->is_enabled = false;
+        for (int i = 1; i < argc; ++i)
+            registered_bench->is_enabled |= argv[i] && strstr(registered_bench->name, argv[i]);
+    }
+}
+
+bool run_benches(FILE* file, size_t scale) {
+    bench_output = file;
+    VEC_FOREACH(struct registered_bench, registered_bench, benches) {
+        if (!registered_bench->is_enabled)
+            continue;
+        registered_bench->func(&(struct bench) { .name = registered_bench->name, .scale = scale });
+    }
+    bench_vec_destroy(&benches);
+    return true;
+}
+
+size_t bench_size(const struct bench* bench, size_t default_size) {
+    size_t size = default_size * bench->scale / 100;
+    return size > 0 ? size : 1;
+}
+
+void bench_start(struct bench* bench) {
+    timespec_get(&bench->start, TIME_UTC);
+}
+
+void bench_stop(struct bench* bench, const char* phase, size_t item_count) {
+    struct timespec stop;
+    timespec_get(&stop, TIME_UTC);
+    double seconds =
+        (double)(stop.tv_sec - bench->start.tv_sec) +
+        (double)(stop.tv_nsec - bench->start.tv_nsec) * 1.0e-9;
+    fprintf(bench_output, "%-32s %-16s %12zu items %10.3f ms %10.3f Mitems/s\n",
+        bench->name, phase, item_count, seconds * 1.0e3,
+        seconds > 0 ? (double)item_count / seconds * 1.0e-6 : 0.0);
+    fflush(bench_output);
+}
+
+void bench_report(struct bench* bench, const char* metric, double value) {
+    fprintf(bench_output, "%-32s %-16s %12.3f\n", bench->name, metric, value);
+    fflush(bench_output);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+/// State of a running benchmark. A benchmark can time several phases, each of which is reported on
+/// a separate line.
+struct bench {
+    const char* name;
+    size_t scale;
+    struct timespec start;
+};
+
+typedef void (*bench_func)(struct bench*);
+
+void register_bench(const char* name, bench_func func);
+void print_benches(FILE*);
+void filter_benches(int argc, char** argv);
+bool run_benches(FILE*, size_t scale);
+
+/// Scales the given problem size by the scale factor given on the command line (in percent).
+size_t bench_size(const struct bench*, size_t default_size);
+
+/// Starts timing a phase of the benchmark.
+void bench_start(struct bench*);
+/// Stops timing the current phase and reports its throughput for the given number of items.
+void bench_stop(struct bench*, const char* phase, size_t item_count);
+/// Reports an additional measurement for the benchmark.
+void bench_report(struct bench*, const char* metric, double value);
+
+#define BENCH(name) \
+    static void bench_##name(struct bench*); \
+    [[gnu::constructor]] static void register_bench_##name(void) { register_bench(#name, bench_##name); } \
+    static void bench_##name(struct bench* bench)
@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "build.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <overture/mem_stream.h>
+
+#include <stdlib.h>
+
+BENCH(binary_load) {
+    size_t func_count = bench_size(bench, 40000);
+    struct fir_mod* mod = fir_mod_create("module");
+    for (size_t i = 0; i < func_count; ++i)
+        fir_node_make_external(build_iter_pow(mod));
+
+    struct mem_stream text;
+    mem_stream_init(&text);
+    fir_mod_print(text.file, mod, &(struct fir_mod_print_options) {
+        .tab = "    ",
+        .verbosity = FIR_VERBOSITY_MEDIUM,
+        .disable_colors = true
+    });
+    mem_stream_destroy(&text);
+
+    struct mem_stream binary;
+    mem_stream_init(&binary);
+    bench_start(bench);
+    fir_mod_write_binary(binary.file, mod);
+    mem_stream_destroy(&binary);
+    bench_stop(bench, "write binary", func_count);
+    fir_mod_destroy(mod);
+
+    bench_report(bench, "text MB", (double)text.size / 1.0e6);
+    bench_report(bench, "binary MB", (double)binary.size / 1.0e6);
+
+    // Loading is measured from memory, so that the file system does not get in the way.
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "module.fir",
+        .file_data = text.buf,
+        .file_size = text.size,
+        .error_log = stderr
+    });
+    bench_stop(bench, "parse text", func_count);
+    fir_mod_destroy(mod);
+
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_read_binary(mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = binary.buf,
+        .data_size = binary.size,
+        .error_log = stderr
+    });
+    bench_stop(bench, "read binary", func_count);
+    fir_mod_destroy(mod);
+
+    // Loading a library lazily to use a single function only pays for that function.
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_read_binary(mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = binary.buf,
+        .data_size = binary.size,
+        .error_log = stderr,
+        .is_lazy = true
+    });
+    fir_node_materialize(fir_mod_first_external(mod));
+    bench_stop(bench, "read lazily", func_count);
+    bench_start(bench);
+    fir_mod_materialize(mod);
+    bench_stop(bench, "materialize", func_count);
+    fir_mod_destroy(mod);
+
+    free(text.buf);
+    free(binary.buf);
+}
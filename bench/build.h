@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+struct fir_mod;
+struct fir_node;
+
+/// Builds a function computing a chain of additions of the given length. Returns the last addition.
+const struct fir_node* build_arith_chain(struct fir_mod*, size_t op_count);
+/// Builds a recursive integer power function (same as the one used in the unit tests).
+struct fir_node* build_rec_pow(struct fir_mod*);
+/// Builds an iterative integer power function (same as the one used in the unit tests).
+struct fir_node* build_iter_pow(struct fir_mod*);
+/// Builds a function made of a chain of basic-blocks, each containing the given number of
+/// arithmetic operations and branching either to the next block or to the exit block.
+struct fir_node* build_block_chain(struct fir_mod*, size_t block_count, size_t ops_per_block);
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include "build.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define MAX_THREAD_COUNT 16
+
+struct build_task {
+    struct fir_mod* mod;
+    size_t func_count;
+    bool use_builder;
+};
+
+static void* build_funcs(void* data) {
+    const struct build_task* task = data;
+    struct fir_mod_builder* builder = task->use_builder ? fir_mod_builder_create(task->mod) : NULL;
+    struct fir_mod* mod = builder ? fir_mod_builder_mod(builder) : task->mod;
+    for (size_t i = 0; i < task->func_count; ++i)
+        fir_node_make_external(build_iter_pow(mod));
+    if (builder) {
+        fir_mod_builder_commit(builder);
+        fir_mod_builder_destroy(builder);
+    }
+    return NULL;
+}
+
+static void build_in_parallel(struct fir_mod* mod, size_t func_count, size_t thread_count, bool use_builder) {
+    pthread_t threads[MAX_THREAD_COUNT];
+    struct build_task tasks[MAX_THREAD_COUNT];
+    for (size_t i = 0; i < thread_count; ++i) {
+        tasks[i] = (struct build_task) {
+            .mod = mod,
+            .func_count = func_count / thread_count,
+            .use_builder = use_builder
+        };
+        pthread_create(&threads[i], NULL, build_funcs, &tasks[i]);
+    }
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+}
+
+BENCH(concurrent_construction) {
+    size_t func_count = bench_size(bench, 100000);
+
+    // The baseline is a regular module, which does not take any lock.
+    struct fir_mod* mod = fir_mod_create("module");
+    bench_start(bench);
+    build_funcs(&(struct build_task) { .mod = mod, .func_count = func_count });
+    bench_stop(bench, "sequential", func_count);
+    fir_mod_destroy(mod);
+
+    // Every thread builds the same kind of function, which makes them compete for the shared types
+    // and constants, but not for the rest of the nodes.
+    // With builders, threads only share the module when they commit their functions.
+    for (size_t thread_count = 1; thread_count <= MAX_THREAD_COUNT; thread_count *= 2) {
+        for (int use_builder = 0; use_builder <= 1; ++use_builder) {
+            char phase[32];
+            snprintf(phase, sizeof(phase), use_builder ? "%zu builder(s)" : "%zu thread(s)", thread_count);
+            mod = fir_mod_create_concurrent("module");
+            bench_start(bench);
+            build_in_parallel(mod, func_count, thread_count, use_builder);
+            bench_stop(bench, phase, func_count);
+            fir_mod_destroy(mod);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#include "bench.h"
+
+#include <overture/cli.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct options {
+    char* scale;
+};
+
+static enum cli_state usage(void*, char*) {
+    printf(
+        "usage: benchmarks [options] filters ...\n"
+        "options:\n"
+        "   -h    --help       Shows this message.\n"
+        "         --list       Lists all benchmarks and exit.\n"
+        "         --scale <n>  Scales problem sizes by the given percentage (default: 100).\n");
+    return CLI_STATE_ERROR;
+}
+
+static enum cli_state list_benches(void*, char*) {
+    print_benches(stdout);
+    return CLI_STATE_ERROR;
+}
+
+int main(int argc, char** argv) {
+    struct options options = { .scale = "100" };
+    struct cli_option cli_options[] = {
+        { .short_name = "-h", .long_name = "--help", .parse = usage },
+        { .long_name = "--list", .parse = list_benches },
+        cli_option_string(NULL, "--scale", &options.scale),
+    };
+    if (!cli_parse_options(argc, argv, cli_options, sizeof(cli_options) / sizeof(cli_options[0])))
+        return 1;
+
+    char* scale_end = NULL;
+    unsigned long scale = strtoul(options.scale, &scale_end, 10);
+    if (*scale_end != 0 || scale == 0) {
+        fprintf(stderr, "invalid scale '%s'\n", options.scale);
+        return 1;
+    }
+
+    filter_benches(argc, argv);
+    return run_benches(stdout, scale) ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+#include "bench.h"
+#include "build.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+#include <fir/dbg_info.h>
+
+#include <overture/mem.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+BENCH(node_creation) {
+    size_t op_count = bench_size(bench, 1000000);
+    struct fir_mod* mod = fir_mod_create("module");
+
+    // Each iteration creates a constant and an addition.
+    bench_start(bench);
+    build_arith_chain(mod, op_count);
+    bench_stop(bench, "create", op_count * 2);
+
+    bench_start(bench);
+    fir_mod_destroy(mod);
+    bench_stop(bench, "destroy", op_count * 2);
+}
+
+BENCH(node_reuse) {
+    size_t op_count = bench_size(bench, 1000000);
+    struct fir_mod* mod = fir_mod_create("module");
+
+    // Nothing is exported, so cleaning up places every node on the free lists of the module.
+    build_arith_chain(mod, op_count);
+    bench_start(bench);
+    fir_mod_cleanup(mod);
+    bench_stop(bench, "cleanup", op_count * 2);
+
+    bench_start(bench);
+    build_arith_chain(mod, op_count);
+    bench_stop(bench, "recreate", op_count * 2);
+
+    fir_mod_destroy(mod);
+}
+
+BENCH(nominal_node_creation) {
+    size_t func_count = bench_size(bench, 1000000);
+    struct fir_mod* mod = fir_mod_create("module");
+    const struct fir_node* int64_ty = fir_int_ty(mod, 64);
+    const struct fir_node* func_ty = fir_func_ty(int64_ty, int64_ty);
+
+    bench_start(bench);
+    for (size_t i = 0; i < func_count; ++i)
+        fir_func(func_ty);
+    bench_stop(bench, "create", func_count);
+
+    bench_start(bench);
+    fir_mod_destroy(mod);
+    bench_stop(bench, "destroy", func_count);
+}
+
+static void report_hash_cons_stats(struct bench* bench, const struct fir_mod* mod) {
+    struct fir_hash_cons_stats stats = fir_mod_hash_cons_stats(mod);
+    size_t lookup_count = stats.hit_count + stats.miss_count;
+    bench_report(bench, "hits", stats.hit_count);
+    bench_report(bench, "misses", stats.miss_count);
+    bench_report(bench, "avg. probes", lookup_count > 0 ? (double)stats.probe_count / lookup_count : 0);
+}
+
+BENCH(hash_cons_lookup) {
+    size_t op_count = bench_size(bench, 1000000);
+    struct fir_mod* mod = fir_mod_create("module");
+    const struct fir_node* int64_ty = fir_int_ty(mod, 64);
+    struct fir_node* func = fir_func(fir_func_ty(int64_ty, int64_ty));
+    const struct fir_node* param = fir_param(func);
+
+    bench_start(bench);
+    for (size_t i = 0; i < op_count; ++i)
+        fir_iarith_op(FIR_IMUL, NULL, param, fir_int_const(int64_ty, i));
+    bench_stop(bench, "insert", op_count * 2);
+
+    // The second round only finds existing nodes.
+    bench_start(bench);
+    for (size_t i = 0; i < op_count; ++i)
+        fir_iarith_op(FIR_IMUL, NULL, param, fir_int_const(int64_ty, i));
+    bench_stop(bench, "find", op_count * 2);
+
+    report_hash_cons_stats(bench, mod);
+    fir_mod_destroy(mod);
+}
+
+static void report_mem_stats(struct bench* bench, const struct fir_mod* mod) {
+    struct fir_mem_stats mem_stats = fir_mod_mem_stats(mod);
+    bench_report(bench, "nodes", mem_stats.node_count);
+    bench_report(bench, "header bytes", sizeof(struct fir_node));
+    bench_report(bench, "bytes/node", (double)(mem_stats.node_bytes + mem_stats.use_bytes) / mem_stats.node_count);
+    bench_report(bench, "pool bytes/node", (double)mem_stats.pool_bytes / mem_stats.node_count);
+    bench_report(bench, "table bytes/node", (double)mem_stats.table_bytes / mem_stats.node_count);
+}
+
+BENCH(node_memory_chain) {
+    // Each addition comes with a new constant.
+    struct fir_mod* mod = fir_mod_create("module");
+    build_arith_chain(mod, bench_size(bench, 10000000) / 2);
+    report_mem_stats(bench, mod);
+    fir_mod_destroy(mod);
+}
+
+BENCH(node_memory_funcs) {
+    size_t func_count = bench_size(bench, 100000);
+    struct fir_mod* mod = fir_mod_create("module");
+    for (size_t i = 0; i < func_count; ++i) {
+        build_rec_pow(mod);
+        build_iter_pow(mod);
+    }
+    report_mem_stats(bench, mod);
+    fir_mod_destroy(mod);
+}
+
+static void replace_funcs(struct fir_mod* mod, struct fir_node** funcs, size_t change_count) {
+    for (size_t i = 0; i < change_count; ++i) {
+        fir_node_make_internal(funcs[i]);
+        funcs[i] = build_iter_pow(mod);
+        fir_node_make_external(funcs[i]);
+    }
+}
+
+BENCH(cleanup_after_change) {
+    size_t func_count = bench_size(bench, 10000);
+    size_t change_count = func_count / 100;
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node** funcs = xmalloc(sizeof(struct fir_node*) * func_count);
+    for (size_t i = 0; i < func_count; ++i) {
+        funcs[i] = build_iter_pow(mod);
+        fir_node_make_external(funcs[i]);
+    }
+    fir_mod_cleanup(mod);
+
+    // Only one function out of a hundred is replaced between two collections.
+    replace_funcs(mod, funcs, change_count);
+    bench_start(bench);
+    fir_mod_cleanup(mod);
+    bench_stop(bench, "full", change_count);
+
+    replace_funcs(mod, funcs, change_count);
+    bench_start(bench);
+    fir_mod_cleanup_incremental(mod);
+    bench_stop(bench, "incremental", change_count);
+
+    bench_report(bench, "nodes", fir_mod_mem_stats(mod).node_count);
+    free(funcs);
+    fir_mod_destroy(mod);
+}
+
+BENCH(link_modules) {
+    size_t mod_count = bench_size(bench, 1000);
+    struct fir_dbg_info_pool* dbg_pool = fir_dbg_info_pool_create();
+    struct fir_mod** mods = xmalloc(sizeof(struct fir_mod*) * mod_count);
+
+    // Every module defines a function, and declares the function defined by the next module.
+    for (size_t i = 0; i < mod_count; ++i) {
+        char name[32];
+        mods[i] = fir_mod_create("module");
+        struct fir_node* func = build_iter_pow(mods[i]);
+        snprintf(name, sizeof(name), "pow_%zu", i);
+        fir_node_set_dbg_info(func, fir_dbg_info(dbg_pool, name, "", (struct fir_source_range) {}));
+        fir_node_make_external(func);
+
+        struct fir_node* next_func = fir_func(func->ty);
+        snprintf(name, sizeof(name), "pow_%zu", (i + 1) % mod_count);
+        fir_node_set_dbg_info(next_func, fir_dbg_info(dbg_pool, name, "", (struct fir_source_range) {}));
+        fir_node_make_external(next_func);
+    }
+
+    // Linking modules one by one indexes the external nodes of the destination module every time.
+    struct fir_mod* mod = fir_mod_create("module");
+    bench_start(bench);
+    for (size_t i = 0; i < mod_count; ++i)
+        fir_mod_link(mod, mods[i], stderr);
+    bench_stop(bench, "link", mod_count);
+    fir_mod_destroy(mod);
+
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_link_all(mod, (const struct fir_mod* const*)mods, mod_count, stderr);
+    bench_stop(bench, "link all", mod_count);
+    bench_report(bench, "nodes", fir_mod_mem_stats(mod).node_count);
+    bench_report(bench, "functions", fir_mod_func_count(mod));
+    fir_mod_destroy(mod);
+
+    for (size_t i = 0; i < mod_count; ++i)
+        fir_mod_destroy(mods[i]);
+    free(mods);
+    fir_dbg_info_pool_destroy(dbg_pool);
+}
+
+BENCH(rollback_after_change) {
+    size_t func_count = bench_size(bench, 10000);
+    size_t change_count = func_count / 100;
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node** funcs = xmalloc(sizeof(struct fir_node*) * func_count);
+    for (size_t i = 0; i < func_count; ++i) {
+        funcs[i] = build_iter_pow(mod);
+        fir_node_make_external(funcs[i]);
+    }
+
+    // The cost of rolling back should only depend on the number of replaced functions.
+    fir_mod_checkpoint(mod);
+    bench_start(bench);
+    replace_funcs(mod, funcs, change_count);
+    bench_stop(bench, "change", change_count);
+
+    bench_start(bench);
+    fir_mod_rollback(mod);
+    bench_stop(bench, "rollback", change_count);
+
+    bench_report(bench, "nodes", fir_mod_mem_stats(mod).node_count);
+    free(funcs);
+    fir_mod_destroy(mod);
+}
@@ -0,0 +1,55 @@
+#include "bench.h"
+#include "build.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <overture/mem_stream.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+BENCH(parse) {
+    size_t func_count = bench_size(bench, 40000);
+    struct fir_mod* mod = fir_mod_create("module");
+    for (size_t i = 0; i < func_count; ++i) {
+        fir_node_make_external(build_iter_pow(mod));
+        fir_node_make_external(build_rec_pow(mod));
+    }
+
+    struct mem_stream text;
+    mem_stream_init(&text);
+    fir_mod_print(text.file, mod, &(struct fir_mod_print_options) {
+        .tab = "    ",
+        .verbosity = FIR_VERBOSITY_MEDIUM,
+        .disable_colors = true
+    });
+    mem_stream_destroy(&text);
+    fir_mod_destroy(mod);
+
+    // Throughput is reported in bytes, so that the number of items per second is in MB/s.
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "module.fir",
+        .file_data = text.buf,
+        .file_size = text.size,
+        .error_log = stderr
+    });
+    bench_stop(bench, "parse memory", text.size);
+    fir_mod_destroy(mod);
+
+    FILE* file = fmemopen(text.buf, text.size, "rb");
+    mod = fir_mod_create("module");
+    bench_start(bench);
+    fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "module.fir",
+        .file_stream = file,
+        .error_log = stderr
+    });
+    bench_stop(bench, "parse stream", text.size);
+    fir_mod_destroy(mod);
+    fclose(file);
+
+    free(text.buf);
+}
@@ -0,0 +1,56 @@
+#include "bench.h"
+#include "build.h"
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <overture/mem_stream.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_THREAD_COUNT 16
+
+BENCH(print) {
+    size_t func_count = bench_size(bench, 40000);
+    // Functions are only printed in parallel in concurrent modules.
+    struct fir_mod* mod = fir_mod_create_concurrent("module");
+    for (size_t i = 0; i < func_count; ++i) {
+        fir_node_make_external(build_iter_pow(mod));
+        fir_node_make_external(build_rec_pow(mod));
+    }
+
+    struct fir_mod_print_options print_options = {
+        .tab = "    ",
+        .verbosity = FIR_VERBOSITY_MEDIUM,
+        .disable_colors = true
+    };
+
+    // Throughput is reported in bytes, so that the number of items per second is in MB/s.
+    struct mem_stream text;
+    mem_stream_init(&text);
+    bench_start(bench);
+    fir_mod_print(text.file, mod, &print_options);
+    mem_stream_flush(&text);
+    bench_stop(bench, "print stream", text.size);
+    mem_stream_destroy(&text);
+    free(text.buf);
+
+    bench_start(bench);
+    char* str = fir_mod_print_to_string(mod, &print_options);
+    bench_stop(bench, "print string", strlen(str));
+    free(str);
+
+    for (size_t thread_count = 2; thread_count <= MAX_THREAD_COUNT; thread_count *= 2) {
+        char phase[32];
+        snprintf(phase, sizeof(phase), "%zu thread(s)", thread_count);
+        print_options.thread_count = thread_count;
+        bench_start(bench);
+        str = fir_mod_print_to_string(mod, &print_options);
+        bench_stop(bench, phase, strlen(str));
+        free(str);
+    }
+
+    fir_mod_destroy(mod);
+}
@@ -28,8 +28,42 @@ struct fir_dbg_info_pool;
 
 /// Creates a module with the given name.
 FIR_SYMBOL struct fir_mod* fir_mod_create(const char* name);
+/// Creates a module with the given name, in which nodes can be created from several threads at
+/// the same time. Hash-consing is done on a table split into shards that are locked independently,
+/// and use lists, nominal nodes, and the list of external nodes are updated under locks. Setting
+/// the operands of the same nominal node from different threads, as well as cleaning up, printing,
+/// or otherwise inspecting the module while nodes are being created, is not allowed.
+FIR_SYMBOL struct fir_mod* fir_mod_create_concurrent(const char* name);
 /// Destroys the given module. This releases memory holding all the nodes in the module.
 FIR_SYMBOL void fir_mod_destroy(struct fir_mod*);
+/// @return `true` if the given module was created with @ref fir_mod_create_concurrent.
+FIR_SYMBOL bool fir_mod_is_concurrent(const struct fir_mod*);
+
+/// @struct fir_mod_builder
+/// Module builder, used to create nodes privately before adding them to a module in one batch.
+/// A builder owns a private module, in which nodes are created with the regular constructors, and
+/// which has its own hash-consing table. This makes it possible to build independent parts of a
+/// module (e.g. functions) in different threads without any contention.
+struct fir_mod_builder;
+
+/// Creates a builder for the given module.
+FIR_SYMBOL struct fir_mod_builder* fir_mod_builder_create(struct fir_mod* mod);
+/// Destroys the given builder, along with its private module.
+FIR_SYMBOL void fir_mod_builder_destroy(struct fir_mod_builder*);
+/// Returns the private module of the builder, in which nodes should be created.
+FIR_SYMBOL struct fir_mod* fir_mod_builder_mod(struct fir_mod_builder*);
+/// Adds the functions and global variables of the private module, along with the nodes they use,
+/// to the module of the builder. Structural nodes that already exist in that module are reused.
+/// Nominal nodes that were committed previously are not committed again, and must therefore not
+/// be modified after being committed. Several builders can commit at the same time only if their
+/// module was created with @ref fir_mod_create_concurrent.
+FIR_SYMBOL void fir_mod_builder_commit(struct fir_mod_builder*);
+/// Returns the node that corresponds to the given node of the private module in the module of the
+/// builder, or `NULL` if that node has not been committed. The result can be safely cast to a
+/// non-`const` pointer if the given node is nominal.
+FIR_SYMBOL const struct fir_node* fir_mod_builder_find(
+    const struct fir_mod_builder*,
+    const struct fir_node*);
 
 /// Returns the module name.
 FIR_SYMBOL const char* fir_mod_name(const struct fir_mod*);
@@ -45,6 +79,79 @@ FIR_SYMBOL void fir_mod_set_name_with_length(struct fir_mod*, const char* name,
 /// point to valid memory after a call to this function. Types remain valid and are _not_ reclaimed.
 FIR_SYMBOL void fir_mod_cleanup(struct fir_mod*);
 
+/// Cleans up the module incrementally. Only the nodes that were created, or that lost a use, since
+/// the last clean up are considered, which makes the complexity of this function proportional to the
+/// size of the changes made to the module rather than to the size of the module. This collection is
+/// conservative: Some dead nodes (for instance, those referenced through the `ctrl` field of other
+/// dead nodes) may be kept until the next call to @ref fir_mod_cleanup.
+/// @warning Like @ref fir_mod_cleanup, the memory used by dead nodes is reclaimed.
+FIR_SYMBOL void fir_mod_cleanup_incremental(struct fir_mod*);
+
+/// Cleans up the module like @ref fir_mod_cleanup, but also reclaims the types that are no longer
+/// used by any live node. The types cached by the module (e.g. @ref fir_mem_ty or @ref fir_bool_ty)
+/// are always kept. This is meant for long-lived modules, in which types would otherwise accumulate.
+/// @warning Any pointer to a type that was not used by a live node is invalidated.
+FIR_SYMBOL void fir_mod_cleanup_types(struct fir_mod*);
+
+/// Renumbers the nodes of the module so that their IDs lie in `[0, n)`, where `n` is the number of
+/// nodes in the module, while preserving their relative order. This is typically done after a call
+/// to @ref fir_mod_cleanup, so that analyses can use arrays indexed by node IDs. IDs are 32-bit wide,
+/// and creating a node once they are exhausted aborts the program, which long-lived modules avoid
+/// by compacting them regularly.
+/// @warning Any data structure that depends on node IDs (including analyses) must be recomputed.
+FIR_SYMBOL void fir_mod_compact_ids(struct fir_mod*);
+
+/// Creates a checkpoint in the module. From then on, new nodes, changes to the operands of nominal
+/// nodes, and changes to the list of external nodes are recorded, so that they can be undone with
+/// @ref fir_mod_rollback, in time proportional to the number of changes. Debug information is not
+/// recorded. Checkpoints can be nested. Cleaning up the module or compacting its IDs while a
+/// checkpoint is active is not allowed, and concurrent modules do not support checkpoints. Lazy
+/// functions are materialized when the checkpoint is created, and modules must not be read lazily
+/// while a checkpoint is active.
+FIR_SYMBOL void fir_mod_checkpoint(struct fir_mod*);
+/// Undoes all the changes made since the last checkpoint, and removes that checkpoint.
+/// @warning Any pointer to a node created since the checkpoint is invalidated.
+FIR_SYMBOL void fir_mod_rollback(struct fir_mod*);
+/// Keeps the changes made since the last checkpoint, and removes that checkpoint. The changes are
+/// still undone if an enclosing checkpoint is rolled back.
+FIR_SYMBOL void fir_mod_commit(struct fir_mod*);
+
+/// Observer notified of the changes made to a module, typically used to keep data derived from the
+/// module (e.g. analyses) up-to-date. Observers are registered with @ref fir_mod_add_observer.
+struct fir_mod_observer {
+    /// Called after an operand of a nominal node has been set, including when a change is undone by
+    /// @ref fir_mod_rollback. The new operand is `node->ops[op_index]`.
+    void (*set_op)(struct fir_mod_observer*, const struct fir_node* node, size_t op_index);
+    /// Called after nodes have been removed or renumbered, which happens when the module is cleaned
+    /// up, when its IDs are compacted, or when it is rolled back. Any node or ID held by the observer
+    /// should then be considered invalid.
+    void (*reset)(struct fir_mod_observer*);
+};
+
+/// Registers an observer on the given module. Observers are not supported on concurrent modules,
+/// and must be removed before the module is destroyed.
+FIR_SYMBOL void fir_mod_add_observer(struct fir_mod*, struct fir_mod_observer*);
+/// Removes an observer previously registered with @ref fir_mod_add_observer.
+FIR_SYMBOL void fir_mod_remove_observer(struct fir_mod*, struct fir_mod_observer*);
+
+/// Links a module into another. All the nodes of the source module are imported into the
+/// destination module, in which structural nodes are deduplicated against existing ones. External
+/// functions and global variables are resolved by name: An imported node is replaced by the node
+/// with the same name in the other module, whether it is imported or exported. Two external nodes
+/// with the same name conflict if they have different tags or types, or if both are exported.
+/// @param error_log Where conflicts are reported, or `NULL` to disable error reporting.
+/// @return `true` on success. On failure, no nominal node is added to the destination module.
+FIR_SYMBOL bool fir_mod_link(struct fir_mod* dst, const struct fir_mod* src, FILE* error_log);
+/// Links several modules into another, in order. This is equivalent to calling @ref fir_mod_link
+/// on every source module, but faster, as the external nodes of the destination module are only
+/// indexed once. Modules that fail to link are skipped.
+/// @return `true` if all the modules were linked successfully.
+FIR_SYMBOL bool fir_mod_link_all(
+    struct fir_mod* dst,
+    const struct fir_mod* const* srcs,
+    size_t src_count,
+    FILE* error_log);
+
 /// Returns the functions of the module.
 FIR_SYMBOL struct fir_node* const* fir_mod_funcs(const struct fir_mod*);
 /// Returns the global variables of the module.
@@ -53,6 +160,76 @@ FIR_SYMBOL struct fir_node* const* fir_mod_globals(const struct fir_mod*);
 FIR_SYMBOL size_t fir_mod_func_count(const struct fir_mod*);
 /// Returns the number of global variables in the module.
 FIR_SYMBOL size_t fir_mod_global_count(const struct fir_mod*);
+/// Returns the first external node of the module, or `NULL` if there is none. External nodes are
+/// listed in the order in which they were made external.
+/// @see fir_node_next_external.
+FIR_SYMBOL struct fir_node* fir_mod_first_external(const struct fir_mod*);
+/// Returns the external node following the given one, or `NULL` if this is the last one.
+/// @see fir_mod_first_external.
+FIR_SYMBOL struct fir_node* fir_node_next_external(const struct fir_node*);
+
+/// Memory used by a module.
+struct fir_mem_stats {
+    size_t node_count;  ///< Number of nodes (structural or nominal) in the module.
+    size_t node_bytes;  ///< Bytes used by node headers and operands.
+    size_t use_bytes;   ///< Bytes used by use records.
+    size_t pool_bytes;  ///< Bytes reserved for nodes, including nodes waiting to be reused.
+    size_t table_bytes; ///< Bytes used by the hash-consing table.
+};
+
+/// Returns the memory used by the given module. This is linear in the number of nodes.
+FIR_SYMBOL struct fir_mem_stats fir_mod_mem_stats(const struct fir_mod*);
+
+/// Statistics about hash-consing in a module.
+struct fir_hash_cons_stats {
+    size_t hit_count;   ///< Number of lookups that found an existing node.
+    size_t miss_count;  ///< Number of lookups that did not find an existing node.
+    size_t probe_count; ///< Number of hash table slots examined by all lookups.
+};
+
+/// Returns hash-consing statistics accumulated since the creation of the module.
+/// The average probe length is `probe_count / (hit_count + miss_count)`.
+FIR_SYMBOL struct fir_hash_cons_stats fir_mod_hash_cons_stats(const struct fir_mod*);
+
+/// Statistics about the nodes reclaimed by clean ups.
+struct fir_reclaim_stats {
+    size_t node_count;  ///< Number of reclaimed nodes, including types and constants.
+    size_t node_bytes;  ///< Bytes used by reclaimed nodes, including types and constants.
+    size_t type_count;  ///< Number of reclaimed types.
+    size_t type_bytes;  ///< Bytes used by reclaimed types.
+    size_t const_count; ///< Number of reclaimed constants.
+    size_t const_bytes; ///< Bytes used by reclaimed constants.
+};
+
+/// Returns the number of nodes reclaimed by clean ups since the creation of the module.
+FIR_SYMBOL struct fir_reclaim_stats fir_mod_reclaim_stats(const struct fir_mod*);
+
+/// Number of entries in the probe length histogram of @ref fir_mod_stats.
+#define FIR_PROBE_HISTOGRAM_SIZE 16
+
+/// Statistics about a module, meant to diagnose its memory usage.
+struct fir_mod_stats {
+    size_t tag_counts[FIR_NODE_TAG_COUNT]; ///< Number of nodes with each tag.
+    size_t func_count;                     ///< Number of functions.
+    size_t global_count;                   ///< Number of global variables.
+    size_t local_count;                    ///< Number of local variables.
+    size_t lazy_func_count;                ///< Number of functions with a body not loaded yet.
+    size_t materialized_func_count;        ///< Number of lazy functions materialized so far.
+    struct fir_mem_stats mem;              ///< Memory used by nodes and uses.
+    size_t free_node_count;                ///< Number of nodes waiting to be reused.
+    size_t free_node_bytes;                ///< Bytes used by nodes waiting to be reused.
+    size_t table_capacity;                 ///< Number of slots in the hash-consing table.
+    size_t table_node_count;               ///< Number of nodes in the hash-consing table.
+    double table_load_factor;              ///< Ratio of used slots in the hash-consing table.
+    struct fir_hash_cons_stats hash_cons;  ///< Hash-consing statistics.
+    double hit_rate;                       ///< Ratio of lookups that found an existing node.
+    /// Number of nodes of the hash-consing table that are found after `i + 1` probes, for each entry
+    /// `i`. The last entry also counts the nodes that need more probes.
+    size_t probe_histogram[FIR_PROBE_HISTOGRAM_SIZE];
+};
+
+/// Returns statistics about the given module. This is linear in the number of nodes.
+FIR_SYMBOL struct fir_mod_stats fir_mod_stats(const struct fir_mod*);
 
 /// @name Printing
 /// @{
@@ -63,14 +240,25 @@ struct fir_mod_print_options {
     const char* tab;              ///< String used as a tabulation character.
     bool disable_colors;          ///< Disables terminal colors in the output.
     enum fir_verbosity verbosity; ///< Verbosity of the output (when applicable).
+    size_t thread_count;          ///< Number of threads analysing functions (0 or 1 to use none).
 };
 
-/// Prints the given module on the given stream.
+/// Prints the given module on the given stream. The output is buffered and written in large chunks.
+/// When several threads are requested and the module was created with @ref fir_mod_create_concurrent,
+/// functions are printed in parallel, but the output is the same as when printing sequentially.
+/// Analysing a function looks up nodes in the module, which is only thread-safe on concurrent
+/// modules, so other modules are always printed sequentially.
 FIR_SYMBOL void fir_mod_print(
     FILE* file,
     const struct fir_mod*,
     const struct fir_mod_print_options*);
 
+/// Prints the given module into a string.
+/// @return A `NULL`-terminated string, which must be freed with `free()`.
+FIR_SYMBOL char* fir_mod_print_to_string(
+    const struct fir_mod*,
+    const struct fir_mod_print_options*);
+
 /// Prints the given module on the standard output.
 FIR_SYMBOL void fir_mod_dump(const struct fir_mod*);
 
@@ -86,6 +274,11 @@ struct fir_parse_input {
     size_t file_size;      ///< File size, excluding the `NULL` terminator.
     FILE* error_log;       ///< Where errors will be reported, or `NULL` to disable error reporting.
 
+    /// Stream to read the module from instead of `file_data`, or `NULL`. The stream is read through a
+    /// bounded buffer, so that the file never has to be entirely loaded in memory. Error messages
+    /// do not show excerpts of the source code in that case.
+    FILE* file_stream;
+
     /// Where to store debug information, or `NULL` to discard debug information.
     struct fir_dbg_info_pool* dbg_pool;
 };
@@ -96,6 +289,56 @@ FIR_SYMBOL bool fir_mod_parse(struct fir_mod*, const struct fir_parse_input* inp
 
 /// @}
 
+/// @name Binary format
+/// @{
+
+/// Input passed to @ref fir_mod_read_binary.
+struct fir_binary_input {
+    const char* file_name; ///< Name of the file being read, appearing in error messages.
+    const void* data;      ///< Binary data, as produced by @ref fir_mod_write_binary.
+    size_t data_size;      ///< Size of the data, in bytes.
+    FILE* error_log;       ///< Where errors will be reported, or `NULL` to disable error reporting.
+
+    /// Where to store debug information, or `NULL` to discard debug information.
+    struct fir_dbg_info_pool* dbg_pool;
+
+    /// Defers loading the bodies of functions until they are first accessed. When this is set, the
+    /// data must outlive the module, or at least the next call to @ref fir_mod_materialize. This is
+    /// ignored for modules created with @ref fir_mod_create_concurrent, since materializing a
+    /// function is not thread-safe.
+    /// @see fir_node_materialize.
+    bool is_lazy;
+};
+
+/// Writes the given module on the given stream, in a compact binary format. Only the functions
+/// and global variables of the module, and the nodes they use, are written.
+/// @return `true` on success, otherwise `false`.
+FIR_SYMBOL bool fir_mod_write_binary(FILE* file, const struct fir_mod*);
+
+/// Reads a module written by @ref fir_mod_write_binary, and adds its nodes to the given module.
+/// Reading does not involve any parsing beyond decoding the node table, and only checks that the
+/// encoding is valid: The data must have been produced by @ref fir_mod_write_binary.
+/// @return `true` on success, otherwise `false`.
+FIR_SYMBOL bool fir_mod_read_binary(struct fir_mod*, const struct fir_binary_input* input);
+
+/// Same as @ref fir_mod_read_binary, but reads the binary data from a memory-mapped file. When
+/// loading lazily, the file stays mapped until every function is materialized.
+FIR_SYMBOL bool fir_mod_read_binary_file(
+    struct fir_mod*,
+    const char* file_name,
+    FILE* error_log,
+    struct fir_dbg_info_pool* dbg_pool,
+    bool is_lazy);
+
+/// Materializes the body of every function that was loaded lazily. Function bodies that are
+/// not materialized yet are only visible through @ref FIR_FUNC_BODY, which materializes them on
+/// first access. The uses of the nodes they refer to, in particular, are incomplete until then.
+/// Errors found in the bodies of lazy functions are reported when they are materialized.
+/// @see fir_node_materialize.
+FIR_SYMBOL void fir_mod_materialize(struct fir_mod*);
+
+/// @}
+
 /// @name Types
 /// @{
 
@@ -29,6 +29,12 @@ enum fir_node_tag {
 #undef x
 };
 
+/// Number of node tags.
+#define FIR_NODE_TAG_COUNT (0 FIR_NODE_LIST(FIR_NODE_TAG_COUNT_X))
+/// @cond PRIVATE
+#define FIR_NODE_TAG_COUNT_X(...) + 1
+/// @endcond
+
 /// A _use_ of a node by another node.
 struct fir_use {
     size_t index;                ///< The operand index where the node is used.
@@ -73,7 +79,7 @@ union fir_node_data {
     size_t array_dim;               ///< Array dimension, for fixed-size array types.
 };
 
-/// Properties of structural nodes.
+/// Properties of nodes.
 enum fir_node_props {
     /// The value of invariant nodes do not depend on a parameter, directly or indirectly. Such
     /// nodes are constants from the point of view of the IR.
@@ -81,18 +87,32 @@ enum fir_node_props {
     /// Nodes that do not generate side-effects during evaluation are considered speculatable, which
     /// is an indication for the scheduler that they can be moved in locations that produce
     /// partially-dead code.
-    FIR_PROP_SPECULATABLE = 0x02
+    FIR_PROP_SPECULATABLE = 0x02,
+    /// Set on nominal nodes that are external.
+    /// @see fir_node_make_external, fir_node_make_internal.
+    FIR_PROP_EXTERNAL = 0x04,
+    /// Set on functions read lazily from a binary module whose body is not loaded yet.
+    /// @see fir_node_materialize.
+    FIR_PROP_LAZY = 0x08
 };
 
-/// Members of the @ref fir_node structure.
+/// Members of the @ref fir_node structure. The header is kept compact, since it accounts for most of
+/// the memory used by a module: Identifiers and operand counts are 32-bit wide, and the tag and
+/// properties are stored on 8 bits each. They are plain bytes rather than bit-fields, so that they
+/// are distinct memory locations: The properties of a node may be modified under a lock while
+/// other threads read its tag. The tag holds a @ref fir_node_tag, and the properties a combination
+/// of @ref fir_node_props. A third byte records whether the node is in the list of nodes that the
+/// next cleanup visits. It is atomic, since any thread may add a node to that list.
 #define FIR_NODE(n) \
-    uint64_t id; \
-    enum fir_node_tag tag; \
-    enum fir_node_props props; \
+    uint32_t id; \
+    uint32_t hash; \
+    uint8_t tag; \
+    uint8_t props; \
+    _Atomic(bool) is_dirty; \
+    uint32_t op_count; \
     union fir_node_data data; \
     const struct fir_use* uses; \
     const struct fir_dbg_info* dbg_info; \
-    size_t op_count; \
     union { \
         const struct fir_node* ty; \
         struct fir_mod* mod; \
@@ -260,6 +280,9 @@ FIR_SYMBOL bool fir_node_is_imported(const struct fir_node*);
 FIR_SYMBOL bool fir_node_is_exported(const struct fir_node*);
 /// @see fir_node_tag_can_be_external.
 FIR_SYMBOL bool fir_node_can_be_external(const struct fir_node*);
+/// @return `true` if the given node is a function whose body has not been loaded yet.
+/// @see fir_node_materialize.
+FIR_SYMBOL bool fir_node_is_lazy(const struct fir_node*);
 
 /// @}
 
@@ -282,6 +305,11 @@ FIR_SYMBOL void fir_node_make_external(struct fir_node*);
 /// Marks a node as internal. Only valid for nodes that are external already.
 /// @see fir_node_make_external.
 FIR_SYMBOL void fir_node_make_internal(struct fir_node*);
+/// Loads the body of a function that was read lazily from a binary module, along with the bodies
+/// of the continuations it refers to. This has no effect on other nodes. Materialization is not
+/// thread-safe, even for concurrent modules.
+/// @see fir_mod_read_binary, fir_mod_materialize.
+FIR_SYMBOL void fir_node_materialize(struct fir_node*);
 
 /// Rebuilds the given _structural_ node with new operands and type into the given module.
 /// Constant values and other node-specific data is taken from the original node.
@@ -408,7 +436,7 @@ FIR_SYMBOL const struct fir_use* fir_use_find(
 /// Obtains the initializer of a global variable.
 #define FIR_GLOBAL_INIT(x) (fir_assert_tag((x), FIR_GLOBAL)->ops[0])
 /// Obtains the body of a function.
-#define FIR_FUNC_BODY(x) (fir_assert_tag((x), FIR_FUNC)->ops[0])
+#define FIR_FUNC_BODY(x) (fir_node_materialized(fir_assert_tag((x), FIR_FUNC))->ops[0])
 /// Obtains the memory object of a load.
 #define FIR_LOAD_MEM(x) (fir_assert_tag((x), FIR_LOAD)->ops[0])
 /// Obtains the pointer of a load.
@@ -481,6 +509,12 @@ FIR_SYMBOL const struct fir_use* fir_use_find(
 
 FIR_SYMBOL const struct fir_node* fir_assert_tag_debug(const struct fir_node*, enum fir_node_tag);
 FIR_SYMBOL const struct fir_node* fir_assert_kind_debug(const struct fir_node*, bool (*kind)(const struct fir_node*));
+
+static inline const struct fir_node* fir_node_materialized(const struct fir_node* node) {
+    if (node->props & FIR_PROP_LAZY)
+        fir_node_materialize((struct fir_node*)node);
+    return node;
+}
 /// @endcond
 
 /// @}
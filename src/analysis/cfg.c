@@ -17,9 +17,9 @@ struct cfg cfg_create(const struct scope* scope) {
             (void*)fir_node_func_return(scope->func))
     };
 
-    SET_FOREACH(const struct fir_node*, node_ptr, scope->nodes) {
+    VEC_FOREACH(const struct fir_node*, node_ptr, scope->blocks) {
         const struct fir_node* func = *node_ptr;
-        if (func->tag != FIR_FUNC || !FIR_FUNC_BODY(func))
+        if (!FIR_FUNC_BODY(func))
             continue;
 
         struct graph_node* from = graph_insert(&cfg.graph, (void*)func);
@@ -0,0 +1,234 @@
+#include "manager.h"
+#include "scope.h"
+#include "cfg.h"
+#include "schedule.h"
+
+#include "fir/node.h"
+#include "fir/module.h"
+
+#include <overture/mem.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+struct analysis_entry {
+    const struct fir_node* func;
+    unsigned valid_analyses;
+    struct scope scope;
+    struct cfg cfg;
+    struct schedule schedule;
+};
+
+VEC_DEFINE(analysis_entry_vec, struct analysis_entry*, PRIVATE)
+
+struct analysis_manager {
+    // This must be the first member, since the manager is obtained from the observer by a cast.
+    struct fir_mod_observer observer;
+    struct fir_mod* mod;
+    struct node_map entries;
+    struct analysis_entry_vec entry_list;
+    enum analysis_preserved preserved;
+    struct analysis_stats stats[ANALYSIS_TAG_COUNT];
+
+    // Nodes that the new operand of a nominal node depends on, see `on_set_op`.
+    struct node_vec deps;
+    struct node_vec dep_stack;
+    struct node_bitset visited_deps;
+};
+
+static void invalidate_entry(
+    struct analysis_manager* manager,
+    struct analysis_entry* entry,
+    enum analysis_preserved preserved)
+{
+    if (!(preserved & ANALYSIS_PRESERVE_SCOPE))
+        preserved = ANALYSIS_PRESERVE_NONE;
+    else if (!(preserved & ANALYSIS_PRESERVE_CFG))
+        preserved = ANALYSIS_PRESERVE_SCOPE;
+
+    unsigned invalid_analyses = entry->valid_analyses & ~preserved;
+    if (invalid_analyses & ANALYSIS_PRESERVE_SCHEDULE)
+        schedule_destroy(&entry->schedule);
+    if (invalid_analyses & ANALYSIS_PRESERVE_CFG)
+        cfg_destroy(&entry->cfg);
+    if (invalid_analyses & ANALYSIS_PRESERVE_SCOPE)
+        scope_destroy(&entry->scope);
+    for (size_t i = 0; i < ANALYSIS_TAG_COUNT; ++i) {
+        if (invalid_analyses & (1u << i))
+            manager->stats[i].invalidation_count++;
+    }
+    entry->valid_analyses &= ~invalid_analyses;
+}
+
+static void collect_deps(struct analysis_manager* manager, const struct fir_node* op) {
+    // A node is in the scope of a function if it depends on a node of that scope. Nodes created
+    // after the scope was computed are not in it, so the operands of structural nodes are followed
+    // until nominal nodes, which are either in the scope or not.
+    node_vec_push(&manager->dep_stack, &op);
+    while (manager->dep_stack.elem_count > 0) {
+        const struct fir_node* node = *node_vec_pop(&manager->dep_stack);
+        if (fir_node_is_ty(node) || !node_bitset_insert(&manager->visited_deps, node))
+            continue;
+        node_vec_push(&manager->deps, &node);
+        if (fir_node_is_nominal(node))
+            continue;
+        for (size_t i = 0; i < node->op_count; ++i)
+            node_vec_push(&manager->dep_stack, &node->ops[i]);
+    }
+}
+
+static void clear_deps(struct analysis_manager* manager) {
+    VEC_FOREACH(const struct fir_node*, node_ptr, manager->deps)
+        node_bitset_remove(&manager->visited_deps, *node_ptr);
+    node_vec_clear(&manager->deps);
+}
+
+static bool is_entry_affected(
+    struct analysis_manager* manager,
+    const struct analysis_entry* entry,
+    const struct fir_node* node,
+    const struct fir_node* op)
+{
+    if (node == entry->func || scope_contains(&entry->scope, node))
+        return true;
+    if (!op)
+        return false;
+    if (manager->deps.elem_count == 0)
+        collect_deps(manager, op);
+    VEC_FOREACH(const struct fir_node*, dep_ptr, manager->deps) {
+        if (scope_contains(&entry->scope, *dep_ptr))
+            return true;
+    }
+    return false;
+}
+
+static void on_set_op(struct fir_mod_observer* observer, const struct fir_node* node, size_t op_index) {
+    struct analysis_manager* manager = (struct analysis_manager*)observer;
+    if (manager->preserved == ANALYSIS_PRESERVE_ALL)
+        return;
+
+    // Removing the old operand cannot change the scope of a function unless the node is in it.
+    VEC_FOREACH(struct analysis_entry*, entry_ptr, manager->entry_list) {
+        struct analysis_entry* entry = *entry_ptr;
+        if (!(entry->valid_analyses & ANALYSIS_PRESERVE_SCOPE) ||
+            !is_entry_affected(manager, entry, node, node->ops[op_index]))
+            continue;
+
+        // Scopes are updated in place rather than recomputed, but the analyses built on them are
+        // discarded.
+        if (!(manager->preserved & ANALYSIS_PRESERVE_SCOPE)) {
+            scope_update(&entry->scope, node);
+            manager->stats[ANALYSIS_SCOPE].update_count++;
+        }
+        invalidate_entry(manager, entry, manager->preserved | ANALYSIS_PRESERVE_SCOPE);
+    }
+    clear_deps(manager);
+}
+
+static void on_reset(struct fir_mod_observer* observer) {
+    analysis_manager_invalidate_all((struct analysis_manager*)observer);
+}
+
+struct analysis_manager* analysis_manager_create(struct fir_mod* mod) {
+    struct analysis_manager* manager = xcalloc(1, sizeof(struct analysis_manager));
+    manager->observer = (struct fir_mod_observer) { .set_op = on_set_op, .reset = on_reset };
+    manager->mod = mod;
+    manager->entries = node_map_create();
+    manager->entry_list = analysis_entry_vec_create();
+    manager->deps = node_vec_create();
+    manager->dep_stack = node_vec_create();
+    manager->visited_deps = node_bitset_create();
+    fir_mod_add_observer(mod, &manager->observer);
+    return manager;
+}
+
+void analysis_manager_destroy(struct analysis_manager* manager) {
+    fir_mod_remove_observer(manager->mod, &manager->observer);
+    analysis_manager_invalidate_all(manager);
+    node_map_destroy(&manager->entries);
+    analysis_entry_vec_destroy(&manager->entry_list);
+    node_vec_destroy(&manager->deps);
+    node_vec_destroy(&manager->dep_stack);
+    node_bitset_destroy(&manager->visited_deps);
+    free(manager);
+}
+
+static struct analysis_entry* find_or_insert_entry(struct analysis_manager* manager, const struct fir_node* func) {
+    assert(func->tag == FIR_FUNC);
+    void* const* entry_ptr = node_map_find(&manager->entries, &func);
+    if (entry_ptr)
+        return *entry_ptr;
+
+    struct analysis_entry* entry = xcalloc(1, sizeof(struct analysis_entry));
+    entry->func = func;
+    node_map_insert(&manager->entries, &func, (void*[]) { entry });
+    analysis_entry_vec_push(&manager->entry_list, &entry);
+    return entry;
+}
+
+static bool lookup(struct analysis_manager* manager, struct analysis_entry* entry, enum analysis_tag tag) {
+    if (entry->valid_analyses & (1u << tag)) {
+        manager->stats[tag].hit_count++;
+        return true;
+    }
+    manager->stats[tag].miss_count++;
+    entry->valid_analyses |= 1u << tag;
+    return false;
+}
+
+static struct analysis_entry* find_scope(struct analysis_manager* manager, const struct fir_node* func) {
+    struct analysis_entry* entry = find_or_insert_entry(manager, func);
+    if (!lookup(manager, entry, ANALYSIS_SCOPE))
+        entry->scope = scope_create(func);
+    return entry;
+}
+
+static struct analysis_entry* find_cfg(struct analysis_manager* manager, const struct fir_node* func) {
+    struct analysis_entry* entry = find_or_insert_entry(manager, func);
+    if (!lookup(manager, entry, ANALYSIS_CFG))
+        entry->cfg = cfg_create(&find_scope(manager, func)->scope);
+    return entry;
+}
+
+static struct analysis_entry* find_schedule(struct analysis_manager* manager, const struct fir_node* func) {
+    struct analysis_entry* entry = find_or_insert_entry(manager, func);
+    if (!lookup(manager, entry, ANALYSIS_SCHEDULE))
+        entry->schedule = schedule_create(&find_cfg(manager, func)->cfg);
+    return entry;
+}
+
+const struct scope* analysis_manager_scope(struct analysis_manager* manager, const struct fir_node* func) {
+    return &find_scope(manager, func)->scope;
+}
+
+struct cfg* analysis_manager_cfg(struct analysis_manager* manager, const struct fir_node* func) {
+    return &find_cfg(manager, func)->cfg;
+}
+
+struct schedule* analysis_manager_schedule(struct analysis_manager* manager, const struct fir_node* func) {
+    return &find_schedule(manager, func)->schedule;
+}
+
+void analysis_manager_preserve(struct analysis_manager* manager, enum analysis_preserved preserved) {
+    manager->preserved = preserved;
+}
+
+void analysis_manager_invalidate(struct analysis_manager* manager, const struct fir_node* func) {
+    void* const* entry_ptr = node_map_find(&manager->entries, &func);
+    if (entry_ptr)
+        invalidate_entry(manager, *entry_ptr, ANALYSIS_PRESERVE_NONE);
+}
+
+void analysis_manager_invalidate_all(struct analysis_manager* manager) {
+    VEC_FOREACH(struct analysis_entry*, entry_ptr, manager->entry_list) {
+        invalidate_entry(manager, *entry_ptr, ANALYSIS_PRESERVE_NONE);
+        free(*entry_ptr);
+    }
+    // Entries are keyed by node, and nodes may have been freed or renumbered.
+    node_map_clear(&manager->entries);
+    analysis_entry_vec_clear(&manager->entry_list);
+}
+
+const struct analysis_stats* analysis_manager_stats(const struct analysis_manager* manager, enum analysis_tag tag) {
+    return &manager->stats[tag];
+}
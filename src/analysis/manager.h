@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+
+struct fir_mod;
+struct fir_node;
+struct scope;
+struct cfg;
+struct schedule;
+
+enum analysis_tag {
+    ANALYSIS_SCOPE,
+    ANALYSIS_CFG,
+    ANALYSIS_SCHEDULE,
+    ANALYSIS_TAG_COUNT
+};
+
+// Set of analyses that are preserved by the changes made to a module. Since the CFG is built from
+// the scope and the schedule from the CFG, an analysis is only preserved if the analyses it is built
+// from are preserved as well.
+enum analysis_preserved {
+    ANALYSIS_PRESERVE_NONE     = 0,
+    ANALYSIS_PRESERVE_SCOPE    = 1 << ANALYSIS_SCOPE,
+    ANALYSIS_PRESERVE_CFG      = 1 << ANALYSIS_CFG,
+    ANALYSIS_PRESERVE_SCHEDULE = 1 << ANALYSIS_SCHEDULE,
+    ANALYSIS_PRESERVE_ALL      = ANALYSIS_PRESERVE_SCOPE | ANALYSIS_PRESERVE_CFG | ANALYSIS_PRESERVE_SCHEDULE
+};
+
+struct analysis_stats {
+    size_t hit_count;
+    size_t miss_count;
+    size_t invalidation_count;
+    size_t update_count;
+};
+
+// Caches the scope, CFG, and schedule of the functions of a module, and invalidates them when the
+// module changes. The analyses of a function are affected when an operand of a nominal node in its
+// scope is set, or when a nominal node is given an operand that depends on its scope (which brings
+// that node into the scope). In that case, the scope is updated incrementally (see `scope_update`),
+// and the other analyses are invalidated. Cleaning up the module, compacting its IDs, or rolling it
+// back invalidates every analysis.
+struct analysis_manager;
+
+[[nodiscard]] struct analysis_manager* analysis_manager_create(struct fir_mod*);
+void analysis_manager_destroy(struct analysis_manager*);
+
+// The returned analyses remain valid until they are invalidated by a change to the module, or until
+// the manager is destroyed.
+const struct scope* analysis_manager_scope(struct analysis_manager*, const struct fir_node* func);
+struct cfg* analysis_manager_cfg(struct analysis_manager*, const struct fir_node* func);
+struct schedule* analysis_manager_schedule(struct analysis_manager*, const struct fir_node* func);
+
+// Declares which analyses are preserved by the changes made to the module from now on, typically
+// around a pass that is known not to affect them. By default, no analysis is preserved.
+void analysis_manager_preserve(struct analysis_manager*, enum analysis_preserved);
+void analysis_manager_invalidate(struct analysis_manager*, const struct fir_node* func);
+void analysis_manager_invalidate_all(struct analysis_manager*);
+
+const struct analysis_stats* analysis_manager_stats(const struct analysis_manager*, enum analysis_tag);
@@ -61,7 +61,7 @@ static inline struct graph_node* find_early_block(
     const struct schedule* schedule,
     const struct fir_node* node)
 {
-    struct graph_node** block_ptr = (struct graph_node**)node_map_find(&schedule->early_blocks, &node);
+    struct graph_node** block_ptr = (struct graph_node**)node_array_map_find(&schedule->early_blocks, node);
     return block_ptr ? *block_ptr : NULL;
 }
 
@@ -69,7 +69,7 @@ static inline const struct block_list* find_late_blocks(
     const struct schedule* schedule,
     const struct fir_node* node)
 {
-    struct block_list** late_blocks = (struct block_list**)node_map_find(&schedule->late_blocks, &node);
+    struct block_list** late_blocks = (struct block_list**)node_array_map_find(&schedule->late_blocks, node);
     return late_blocks ? *late_blocks : NULL;
 }
 
@@ -125,7 +125,7 @@ restart:
         }
         assert(early_block);
 
-        node_map_insert(&schedule->early_blocks, &node, (void*)&early_block);
+        node_array_map_insert(&schedule->early_blocks, node, early_block);
         node_vec_pop(&schedule->early_stack);
     }
 
@@ -245,8 +245,10 @@ static inline const struct block_list* compute_late_blocks(
     struct small_graph_node_vec late_blocks;
     small_graph_node_vec_init(&late_blocks);
     for (const struct fir_use* use = node->uses; use; use = use->next) {
-        if (!collect_late_blocks(schedule, &late_blocks, use->user))
+        if (!collect_late_blocks(schedule, &late_blocks, use->user)) {
+            small_graph_node_vec_destroy(&late_blocks);
             return NULL;
+        }
     }
 
     assert(late_blocks.elem_count > 0);
@@ -314,7 +316,7 @@ restart:
             assert(cfg_is_dominated_by(late_blocks->elems[i], early_block));
 #endif
 
-        node_map_insert(&schedule->late_blocks, &node, (void**)&late_blocks);
+        node_array_map_insert(&schedule->late_blocks, node, (void*)late_blocks);
         node_vec_pop(&schedule->late_stack);
     }
 
@@ -326,8 +328,8 @@ restart:
 struct schedule schedule_create(struct cfg* cfg) {
     return (struct schedule) {
         .cfg = cfg,
-        .early_blocks = node_map_create(),
-        .late_blocks = node_map_create(),
+        .early_blocks = node_array_map_create(),
+        .late_blocks = node_array_map_create(),
         .early_stack = node_vec_create(),
         .late_stack = node_vec_create(),
         .liveness = liveness_create(),
@@ -337,8 +339,8 @@ struct schedule schedule_create(struct cfg* cfg) {
 
 void schedule_destroy(struct schedule* schedule) {
     block_list_pool_destroy(&schedule->block_list_pool);
-    node_map_destroy(&schedule->early_blocks);
-    node_map_destroy(&schedule->late_blocks);
+    node_array_map_destroy(&schedule->early_blocks);
+    node_array_map_destroy(&schedule->late_blocks);
     node_vec_destroy(&schedule->early_stack);
     node_vec_destroy(&schedule->late_stack);
     liveness_destroy(&schedule->liveness);
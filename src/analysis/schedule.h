@@ -12,8 +12,8 @@ IMMUTABLE_SET_DECL(block_list, struct graph_node*, PUBLIC)
 
 struct schedule {
     struct cfg* cfg;
-    struct node_map early_blocks;
-    struct node_map late_blocks;
+    struct node_array_map early_blocks;
+    struct node_array_map late_blocks;
     struct node_vec early_stack;
     struct node_vec late_stack;
     struct liveness liveness;
@@ -4,36 +4,183 @@
 #include "fir/module.h"
 
 #include <assert.h>
+#include <stdlib.h>
+
+static int compare_node_ids(const void* left, const void* right) {
+    uint32_t left_id = (*(const struct fir_node* const*)left)->id;
+    uint32_t right_id = (*(const struct fir_node* const*)right)->id;
+    return left_id < right_id ? -1 : left_id > right_id ? 1 : 0;
+}
+
+static void sort_blocks(struct scope* scope) {
+    // Blocks are sorted so that the analyses built on them do not depend on the order of use lists.
+    if (scope->blocks.elem_count > 1)
+        qsort(scope->blocks.elems, scope->blocks.elem_count, sizeof(const struct fir_node*), compare_node_ids);
+}
+
+static void flood(struct scope* scope, struct node_vec* node_stack) {
+    while (node_stack->elem_count > 0) {
+        const struct fir_node* node = *node_vec_pop(node_stack);
+
+        if (node == scope->func || !node_bitset_insert(&scope->nodes, node))
+            continue;
+        node_vec_push(&scope->members, &node);
+        if (node->tag == FIR_FUNC)
+            node_vec_push(&scope->blocks, &node);
+
+        if (node->tag == FIR_PARAM)
+            node_vec_push(node_stack, &FIR_PARAM_FUNC(node));
+
+        for (const struct fir_use* use = node->uses; use; use = use->next)
+            node_vec_push(node_stack, &use->user);
+    }
+}
 
 struct scope scope_create(const struct fir_node* func) {
     assert(func->tag == FIR_FUNC);
-    struct node_set nodes = node_set_create();
+    struct scope scope = {
+        .func = func,
+        .nodes = node_bitset_create(),
+        .members = node_vec_create(),
+        .blocks = node_vec_create()
+    };
     const struct fir_node* param = fir_param(func);
 
     struct node_vec node_stack = node_vec_create();
     node_vec_push(&node_stack, &param);
-    while (node_stack.elem_count > 0) {
-        const struct fir_node* node = *node_vec_pop(&node_stack);
+    flood(&scope, &node_stack);
+    node_vec_destroy(&node_stack);
+
+    sort_blocks(&scope);
+    return scope;
+}
+
+bool scope_contains(const struct scope* scope, const struct fir_node* node) {
+    return node_bitset_find(&scope->nodes, node);
+}
+
+static bool has_op_in_scope(const struct scope* scope, const struct fir_node* node) {
+    // The parameter of the function is the only node of the scope that does not use another one.
+    if (node->tag == FIR_PARAM && FIR_PARAM_FUNC(node) == scope->func)
+        return true;
+    for (size_t i = 0; i < node->op_count; ++i) {
+        if (node->ops[i] && scope_contains(scope, node->ops[i]))
+            return true;
+    }
+    return false;
+}
 
-        if (node == func || !node_set_insert(&nodes, &node))
+static void add_dependent_nodes(struct scope* scope, const struct fir_node* node, struct node_vec* node_stack) {
+    // The operands of the node may be new nodes that are not in the scope yet. Those that use a node
+    // of the scope are the starting points of a flood fill, which reaches the others, as well as the
+    // node itself. Nominal nodes other than the given one are up-to-date, since any change to their
+    // operands goes through this function.
+    struct node_vec op_stack = node_vec_create();
+    struct node_set visited_nodes = node_set_create();
+    node_vec_push(&op_stack, &node);
+    while (op_stack.elem_count > 0) {
+        const struct fir_node* op = *node_vec_pop(&op_stack);
+        if (fir_node_is_ty(op) || !node_set_insert(&visited_nodes, &op))
+            continue;
+        if (op != node && (scope_contains(scope, op) || fir_node_is_nominal(op)))
             continue;
+        if (!scope_contains(scope, op) && has_op_in_scope(scope, op))
+            node_vec_push(node_stack, &op);
+        for (size_t i = 0; i < op->op_count; ++i) {
+            if (op->ops[i])
+                node_vec_push(&op_stack, &op->ops[i]);
+        }
+    }
+    node_set_destroy(&visited_nodes);
+    node_vec_destroy(&op_stack);
+    flood(scope, node_stack);
+}
 
-        if (node->tag == FIR_PARAM)
-            node_vec_push(&node_stack, &FIR_PARAM_FUNC(node));
+static bool depends_on_param(const struct scope* scope, const struct fir_node* node) {
+    // The node may have an operand in the scope that is itself only there because it depends on the
+    // node (e.g. in a loop), so this searches for a path to the parameter of the function that does
+    // not go through the node.
+    bool found = false;
+    struct node_vec op_stack = node_vec_create();
+    struct node_set visited_nodes = node_set_create();
+    node_set_insert(&visited_nodes, &node);
+    for (size_t i = 0; i < node->op_count; ++i) {
+        if (node->ops[i])
+            node_vec_push(&op_stack, &node->ops[i]);
+    }
+    while (!found && op_stack.elem_count > 0) {
+        const struct fir_node* op = *node_vec_pop(&op_stack);
+        if (!scope_contains(scope, op) || !node_set_insert(&visited_nodes, &op))
+            continue;
+        found = op->tag == FIR_PARAM && FIR_PARAM_FUNC(op) == scope->func;
+        for (size_t i = 0; i < op->op_count; ++i) {
+            if (op->ops[i])
+                node_vec_push(&op_stack, &op->ops[i]);
+        }
+    }
+    node_set_destroy(&visited_nodes);
+    node_vec_destroy(&op_stack);
+    return found;
+}
 
-        for (const struct fir_use* use = node->uses; use; use = use->next)
-            node_vec_push(&node_stack, &use->user);
+static void remove_nodes(struct node_vec* nodes, const struct node_bitset* kept_nodes) {
+    size_t node_count = 0;
+    for (size_t i = 0; i < nodes->elem_count; ++i) {
+        if (node_bitset_find(kept_nodes, nodes->elems[i]))
+            nodes->elems[node_count++] = nodes->elems[i];
     }
-    node_vec_destroy(&node_stack);
+    node_vec_resize(nodes, node_count);
+}
 
-    return (struct scope) { func, nodes };
+static void remove_independent_nodes(struct scope* scope, const struct fir_node* node, struct node_vec* node_stack) {
+    // Every node of the scope that uses the given node, directly or indirectly, is removed. Those
+    // that still use a node of the scope are then added back, along with the nodes that use them.
+    // This takes care of cycles, which would keep nodes alive with a simple reference count.
+    struct node_vec removed_nodes = node_vec_create();
+    node_vec_push(node_stack, &node);
+    while (node_stack->elem_count > 0) {
+        const struct fir_node* removed_node = *node_vec_pop(node_stack);
+        if (!node_bitset_remove(&scope->nodes, removed_node))
+            continue;
+        node_vec_push(&removed_nodes, &removed_node);
+        for (const struct fir_use* use = removed_node->uses; use; use = use->next)
+            node_vec_push(node_stack, &use->user);
+    }
+
+    remove_nodes(&scope->members, &scope->nodes);
+    remove_nodes(&scope->blocks, &scope->nodes);
+    VEC_FOREACH(const struct fir_node*, node_ptr, removed_nodes) {
+        if (!scope_contains(scope, *node_ptr) && has_op_in_scope(scope, *node_ptr)) {
+            node_vec_push(node_stack, node_ptr);
+            flood(scope, node_stack);
+        }
+    }
+    node_vec_destroy(&removed_nodes);
 }
 
-bool scope_contains(const struct scope* scope, const struct fir_node* node) {
-    return node_set_find(&scope->nodes, &node) != NULL;
+bool scope_update(struct scope* scope, const struct fir_node* node) {
+    assert(fir_node_is_nominal(node));
+    bool was_in_scope = scope_contains(scope, node);
+    size_t block_count = scope->blocks.elem_count;
+    struct node_vec node_stack = node_vec_create();
+    add_dependent_nodes(scope, node, &node_stack);
+
+    // Replacing an operand can only remove nodes from the scope when the node itself no longer
+    // depends on the parameter of the function, since membership only depends on the operands of a
+    // node.
+    bool has_removed_nodes = was_in_scope && !depends_on_param(scope, node);
+    if (has_removed_nodes)
+        remove_independent_nodes(scope, node, &node_stack);
+    node_vec_destroy(&node_stack);
+
+    if (has_removed_nodes || scope->blocks.elem_count != block_count)
+        sort_blocks(scope);
+    return was_in_scope || scope_contains(scope, node);
 }
 
 void scope_destroy(struct scope* scope) {
-    node_set_destroy(&scope->nodes);
+    node_bitset_destroy(&scope->nodes);
+    node_vec_destroy(&scope->members);
+    node_vec_destroy(&scope->blocks);
     memset(scope, 0, sizeof(struct scope));
 }
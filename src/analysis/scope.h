@@ -4,11 +4,24 @@
 
 #include <stdbool.h>
 
+// The nodes of a scope are stored in a bitset indexed by node ID, which makes membership tests
+// cheap. Members are also listed in the order in which they are found, and the functions (i.e.
+// blocks) among them are listed separately, by increasing ID.
 struct scope {
     const struct fir_node* func;
-    struct node_set nodes;
+    struct node_bitset nodes;
+    struct node_vec members;
+    struct node_vec blocks;
 };
 
 [[nodiscard]] struct scope scope_create(const struct fir_node* func);
 bool scope_contains(const struct scope*, const struct fir_node*);
+
+// Updates the scope after an operand of the given nominal node has been set, without recomputing it
+// from scratch. The new operand is added to the scope if it depends on it. If the node was in the
+// scope, the update then searches for a path from the node to the parameter of the function, and
+// only when there is none are the nodes that depend on it revisited. Structural nodes created since
+// the scope was computed are only added once they are used by a nominal node.
+// Returns `true` if the node belongs to the scope, either before or after the update.
+bool scope_update(struct scope*, const struct fir_node* node);
 void scope_destroy(struct scope*);
@@ -0,0 +1,1177 @@
+#include "fir/module.h"
+#include "fir/dbg_info.h"
+
+#include "binary.h"
+#include "datatypes.h"
+
+#include <overture/vec.h>
+#include <overture/map.h>
+#include <overture/str.h>
+#include <overture/mem.h>
+#include <overture/hash.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The binary format starts with a header made of a magic number and a version number, followed by
+// the module name, a string table, and a table of debug information objects referring to that
+// string table. Then come the type table, in which types appear after their operands, and the
+// table of nominal nodes, which only contains their tag, type, and data. The list of external nodes
+// follows. The format ends with one chunk per nominal node, preceded by the size of each chunk.
+// Chunks are self-contained: They hold the operands of a nominal node along with the structural
+// nodes these operands depend on, stopping at types and nominal nodes, which are referred to by
+// their index in their respective tables. This makes it possible to load the body of a function
+// without reading the rest of the module, at the cost of duplicating the structural nodes that are
+// shared between chunks. Except for the node tags and floating-point constants, every integer is
+// encoded as an unsigned LEB128 varint. Within a chunk, nodes refer to previous nodes by their
+// distance, which keeps varints short.
+
+#define BINARY_MAGIC "FIRB"
+#define BINARY_MAGIC_SIZE 4
+#define BINARY_VERSION 2
+
+enum node_record_flags {
+    NODE_RECORD_HAS_CTRL     = 0x01,
+    NODE_RECORD_HAS_DBG_INFO = 0x02,
+};
+
+// References to nodes are encoded as `((index << NODE_REF_KIND_BITS) | kind) + 1`, where zero
+// means "no node".
+enum node_ref_kind {
+    NODE_REF_LOCAL   = 0, ///< Node of the same chunk, referred to by its distance.
+    NODE_REF_TYPE    = 1, ///< Entry of the type table.
+    NODE_REF_NOMINAL = 2, ///< Entry of the table of nominal nodes.
+};
+
+#define NODE_REF_KIND_BITS 2
+
+static inline uint32_t hash_ptr(uint32_t h, const void* ptr) {
+    return hash_uint64(h, (uintptr_t)ptr);
+}
+
+static inline uint32_t hash_dbg_info(uint32_t h, const struct fir_dbg_info* const* dbg_info) {
+    return hash_ptr(h, *dbg_info);
+}
+
+static inline bool is_dbg_info_equal(
+    const struct fir_dbg_info* const* dbg_info,
+    const struct fir_dbg_info* const* other)
+{
+    return *dbg_info == *other;
+}
+
+static inline uint32_t hash_func(uint32_t h, const struct fir_node* const* func) {
+    return hash_ptr(h, *func);
+}
+
+static inline bool is_func_equal(const struct fir_node* const* func, const struct fir_node* const* other) {
+    return *func == *other;
+}
+
+struct node_slot {
+    enum node_ref_kind kind;
+    size_t chunk_index;
+    size_t index;
+};
+
+VEC_DEFINE(byte_vec, uint8_t, PRIVATE)
+VEC_DEFINE(size_vec, size_t, PRIVATE)
+VEC_DEFINE(node_slot_vec, struct node_slot, PRIVATE)
+VEC_DEFINE(dbg_info_vec, const struct fir_dbg_info*, PRIVATE)
+VEC_DEFINE(str_view_vec, struct str_view, PRIVATE)
+MAP_DEFINE(dbg_info_map, const struct fir_dbg_info*, size_t, hash_dbg_info, is_dbg_info_equal, PRIVATE)
+MAP_DEFINE(string_map, struct str_view, size_t, str_view_hash, str_view_is_equal, PRIVATE)
+MAP_DEFINE(lazy_func_map, const struct fir_node*, size_t, hash_func, is_func_equal, PRIVATE)
+
+struct binary_writer {
+    struct byte_vec bytes;
+    struct byte_vec chunk_bytes;
+    struct size_vec chunk_sizes;
+    struct node_vec types;
+    struct node_vec nominal_nodes;
+    struct node_vec chunk_nodes;
+    struct node_vec stack;
+    struct node_vec type_stack;
+    struct node_slot_vec slots;
+    struct node_array_map slot_indices;
+    struct dbg_info_vec dbg_infos;
+    struct dbg_info_map dbg_info_indices;
+    struct str_view_vec strings;
+    struct string_map string_indices;
+};
+
+static void write_byte(struct byte_vec* bytes, uint8_t byte) {
+    byte_vec_push(bytes, &byte);
+}
+
+static void write_varint(struct byte_vec* bytes, uint64_t val) {
+    while (val >= 0x80) {
+        write_byte(bytes, (uint8_t)(val | 0x80));
+        val >>= 7;
+    }
+    write_byte(bytes, (uint8_t)val);
+}
+
+static void write_string(struct byte_vec* bytes, struct str_view str) {
+    write_varint(bytes, str.length);
+    for (size_t i = 0; i < str.length; ++i)
+        write_byte(bytes, (uint8_t)str.data[i]);
+}
+
+static struct node_slot* find_slot(const struct binary_writer* writer, const struct fir_node* node) {
+    void* const* slot_index = node_array_map_find(&writer->slot_indices, node);
+    return slot_index ? &writer->slots.elems[(uintptr_t)*slot_index - 1] : NULL;
+}
+
+static void insert_slot(struct binary_writer* writer, const struct fir_node* node, const struct node_slot* slot) {
+    // Structural nodes that are shared between chunks get a new slot in every chunk.
+    struct node_slot* existing_slot = find_slot(writer, node);
+    if (existing_slot) {
+        *existing_slot = *slot;
+        return;
+    }
+    node_slot_vec_push(&writer->slots, slot);
+    node_array_map_insert(&writer->slot_indices, node, (void*)(uintptr_t)writer->slots.elem_count);
+}
+
+static size_t insert_string(struct binary_writer* writer, const char* data) {
+    struct str_view str = str_view_from(data ? data : "");
+    const size_t* index = string_map_find(&writer->string_indices, &str);
+    if (index)
+        return *index;
+    string_map_insert(&writer->string_indices, &str, &writer->strings.elem_count);
+    str_view_vec_push(&writer->strings, &str);
+    return writer->strings.elem_count - 1;
+}
+
+static void insert_dbg_info(struct binary_writer* writer, const struct fir_dbg_info* dbg_info) {
+    if (!dbg_info || dbg_info_map_find(&writer->dbg_info_indices, &dbg_info))
+        return;
+    dbg_info_map_insert(&writer->dbg_info_indices, &dbg_info, &writer->dbg_infos.elem_count);
+    dbg_info_vec_push(&writer->dbg_infos, &dbg_info);
+    insert_string(writer, dbg_info->name);
+    insert_string(writer, dbg_info->file_name);
+}
+
+static bool is_type_inserted(struct binary_writer* writer, const struct fir_node* ty) {
+    if (find_slot(writer, ty))
+        return true;
+    node_vec_push(&writer->type_stack, &ty);
+    return false;
+}
+
+static void insert_type(struct binary_writer* writer, const struct fir_node* ty) {
+    if (is_type_inserted(writer, ty))
+        return;
+    while (!node_vec_is_empty(&writer->type_stack)) {
+        const struct fir_node* top = *node_vec_last(&writer->type_stack);
+        if (find_slot(writer, top)) {
+            node_vec_pop(&writer->type_stack);
+            continue;
+        }
+
+        bool is_ready = true;
+        for (size_t i = 0; i < top->op_count; ++i)
+            is_ready &= is_type_inserted(writer, top->ops[i]);
+        if (!is_ready)
+            continue;
+
+        node_vec_pop(&writer->type_stack);
+        insert_slot(writer, top, &(struct node_slot) { .kind = NODE_REF_TYPE, .index = writer->types.elem_count });
+        node_vec_push(&writer->types, &top);
+        insert_dbg_info(writer, top->dbg_info);
+    }
+}
+
+static void insert_nominal_node(struct binary_writer* writer, const struct fir_node* node) {
+    if (find_slot(writer, node))
+        return;
+    insert_type(writer, node->ty);
+    insert_slot(writer, node, &(struct node_slot) { .kind = NODE_REF_NOMINAL, .index = writer->nominal_nodes.elem_count });
+    node_vec_push(&writer->nominal_nodes, &node);
+    insert_dbg_info(writer, node->dbg_info);
+}
+
+static bool is_in_chunk(struct binary_writer* writer, size_t chunk_index, const struct fir_node* node) {
+    if (!node)
+        return true;
+    if (fir_node_is_ty(node)) {
+        insert_type(writer, node);
+        return true;
+    }
+    if (fir_node_is_nominal(node)) {
+        insert_nominal_node(writer, node);
+        return true;
+    }
+    const struct node_slot* slot = find_slot(writer, node);
+    if (slot && slot->chunk_index == chunk_index)
+        return true;
+    node_vec_push(&writer->stack, &node);
+    return false;
+}
+
+static void order_chunk_node(struct binary_writer* writer, size_t chunk_index, const struct fir_node* node) {
+    if (is_in_chunk(writer, chunk_index, node))
+        return;
+    while (!node_vec_is_empty(&writer->stack)) {
+        const struct fir_node* top = *node_vec_last(&writer->stack);
+        const struct node_slot* slot = find_slot(writer, top);
+        if (slot && slot->chunk_index == chunk_index) {
+            node_vec_pop(&writer->stack);
+            continue;
+        }
+
+        bool is_ready = true;
+        is_ready &= is_in_chunk(writer, chunk_index, top->ty);
+        is_ready &= is_in_chunk(writer, chunk_index, top->ctrl);
+        for (size_t i = 0; i < top->op_count; ++i)
+            is_ready &= is_in_chunk(writer, chunk_index, top->ops[i]);
+        if (!is_ready)
+            continue;
+
+        node_vec_pop(&writer->stack);
+        insert_slot(writer, top, &(struct node_slot) {
+            .kind = NODE_REF_LOCAL,
+            .chunk_index = chunk_index,
+            .index = writer->chunk_nodes.elem_count
+        });
+        node_vec_push(&writer->chunk_nodes, &top);
+        insert_dbg_info(writer, top->dbg_info);
+    }
+}
+
+static void write_node_ref(
+    struct byte_vec* bytes,
+    const struct binary_writer* writer,
+    size_t node_index,
+    const struct fir_node* node)
+{
+    if (!node) {
+        write_varint(bytes, 0);
+        return;
+    }
+    const struct node_slot* slot = find_slot(writer, node);
+    assert(slot);
+    uint64_t index = slot->kind == NODE_REF_LOCAL ? node_index - slot->index : slot->index;
+    write_varint(bytes, ((index << NODE_REF_KIND_BITS) | slot->kind) + 1);
+}
+
+static void write_node_data(struct byte_vec* bytes, const struct fir_node* node) {
+    if (node->tag == FIR_FUNC)
+        write_varint(bytes, node->data.func_flags);
+    else if (fir_node_has_mem_flags(node))
+        write_varint(bytes, node->data.mem_flags);
+    else if (fir_node_has_fp_flags(node))
+        write_varint(bytes, node->data.fp_flags);
+    else if (node->tag == FIR_ARRAY_TY)
+        write_varint(bytes, node->data.array_dim);
+    else if (node->tag == FIR_CONST && node->ty->tag == FIR_INT_TY)
+        write_varint(bytes, node->data.int_val);
+    else if (node->tag == FIR_CONST && node->ty->tag == FIR_FLOAT_TY) {
+        uint64_t bits;
+        memcpy(&bits, &node->data.float_val, sizeof(bits));
+        for (size_t i = 0; i < sizeof(bits); ++i)
+            write_byte(bytes, (uint8_t)(bits >> (i * 8)));
+    } else if (fir_node_has_bitwidth(node))
+        write_varint(bytes, node->data.bitwidth);
+}
+
+static void write_node(
+    struct byte_vec* bytes,
+    const struct binary_writer* writer,
+    size_t node_index,
+    const struct fir_node* node)
+{
+    write_byte(bytes, node->tag);
+    write_varint(bytes,
+        (node->ctrl ? NODE_RECORD_HAS_CTRL : 0) |
+        (node->dbg_info ? NODE_RECORD_HAS_DBG_INFO : 0));
+    if (node->dbg_info)
+        write_varint(bytes, *dbg_info_map_find(&writer->dbg_info_indices, &node->dbg_info));
+    if (!fir_node_is_ty(node))
+        write_node_ref(bytes, writer, node_index, node->ty);
+    if (node->ctrl)
+        write_node_ref(bytes, writer, node_index, node->ctrl);
+    write_node_data(bytes, node);
+    if (fir_node_is_nominal(node))
+        return;
+    write_varint(bytes, node->op_count);
+    for (size_t i = 0; i < node->op_count; ++i)
+        write_node_ref(bytes, writer, node_index, node->ops[i]);
+}
+
+static void write_chunk(struct binary_writer* writer, size_t chunk_index, const struct fir_node* node) {
+    // Nominal nodes without operands have an empty chunk.
+    size_t chunk_begin = writer->chunk_bytes.elem_count;
+    bool has_ops = false;
+    for (size_t i = 0; i < node->op_count; ++i)
+        has_ops |= node->ops[i] != NULL;
+
+    if (has_ops) {
+        node_vec_clear(&writer->chunk_nodes);
+        for (size_t i = 0; i < node->op_count; ++i)
+            order_chunk_node(writer, chunk_index, node->ops[i]);
+
+        size_t node_count = writer->chunk_nodes.elem_count;
+        write_varint(&writer->chunk_bytes, node_count);
+        for (size_t i = 0; i < node_count; ++i)
+            write_node(&writer->chunk_bytes, writer, i, writer->chunk_nodes.elems[i]);
+        for (size_t i = 0; i < node->op_count; ++i)
+            write_node_ref(&writer->chunk_bytes, writer, node_count, node->ops[i]);
+    }
+
+    size_t chunk_size = writer->chunk_bytes.elem_count - chunk_begin;
+    size_vec_push(&writer->chunk_sizes, &chunk_size);
+}
+
+static void write_chunks(struct binary_writer* writer, const struct fir_mod* mod) {
+    struct fir_node* const* funcs = fir_mod_funcs(mod);
+    struct fir_node* const* globals = fir_mod_globals(mod);
+    for (size_t i = 0, n = fir_mod_func_count(mod); i < n; ++i)
+        insert_nominal_node(writer, funcs[i]);
+    for (size_t i = 0, n = fir_mod_global_count(mod); i < n; ++i)
+        insert_nominal_node(writer, globals[i]);
+
+    // Writing the chunk of a nominal node appends the nominal nodes it refers to to the list.
+    for (size_t i = 0; i < writer->nominal_nodes.elem_count; ++i) {
+        const struct fir_node* node = writer->nominal_nodes.elems[i];
+        fir_node_materialize((struct fir_node*)node);
+        write_chunk(writer, i, node);
+    }
+}
+
+static void write_source_pos(struct byte_vec* bytes, const struct fir_source_pos* source_pos) {
+    write_varint(bytes, source_pos->row);
+    write_varint(bytes, source_pos->col);
+    write_varint(bytes, source_pos->bytes);
+}
+
+static void write_dbg_infos(struct binary_writer* writer) {
+    write_varint(&writer->bytes, writer->strings.elem_count);
+    VEC_FOREACH(const struct str_view, str, writer->strings) {
+        write_string(&writer->bytes, *str);
+    }
+    write_varint(&writer->bytes, writer->dbg_infos.elem_count);
+    VEC_FOREACH(const struct fir_dbg_info*, dbg_info_ptr, writer->dbg_infos) {
+        const struct fir_dbg_info* dbg_info = *dbg_info_ptr;
+        write_varint(&writer->bytes, insert_string(writer, dbg_info->name));
+        write_varint(&writer->bytes, insert_string(writer, dbg_info->file_name));
+        write_source_pos(&writer->bytes, &dbg_info->source_range.begin);
+        write_source_pos(&writer->bytes, &dbg_info->source_range.end);
+    }
+}
+
+static void write_tables(struct binary_writer* writer, const struct fir_mod* mod) {
+    write_varint(&writer->bytes, writer->types.elem_count);
+    VEC_FOREACH(const struct fir_node*, ty_ptr, writer->types) {
+        write_node(&writer->bytes, writer, 0, *ty_ptr);
+    }
+
+    write_varint(&writer->bytes, writer->nominal_nodes.elem_count);
+    VEC_FOREACH(const struct fir_node*, node_ptr, writer->nominal_nodes) {
+        write_node(&writer->bytes, writer, 0, *node_ptr);
+    }
+
+    size_t external_count = 0;
+    for (const struct fir_node* node = fir_mod_first_external(mod); node; node = fir_node_next_external(node))
+        external_count++;
+    write_varint(&writer->bytes, external_count);
+    for (const struct fir_node* node = fir_mod_first_external(mod); node; node = fir_node_next_external(node))
+        write_varint(&writer->bytes, find_slot(writer, node)->index);
+
+    VEC_FOREACH(const size_t, chunk_size, writer->chunk_sizes) {
+        write_varint(&writer->bytes, *chunk_size);
+    }
+}
+
+bool fir_mod_write_binary(FILE* file, const struct fir_mod* mod) {
+    struct binary_writer writer = {
+        .bytes = byte_vec_create(),
+        .chunk_bytes = byte_vec_create(),
+        .chunk_sizes = size_vec_create(),
+        .types = node_vec_create(),
+        .nominal_nodes = node_vec_create(),
+        .chunk_nodes = node_vec_create(),
+        .stack = node_vec_create(),
+        .type_stack = node_vec_create(),
+        .slots = node_slot_vec_create(),
+        .slot_indices = node_array_map_create(),
+        .dbg_infos = dbg_info_vec_create(),
+        .dbg_info_indices = dbg_info_map_create(),
+        .strings = str_view_vec_create(),
+        .string_indices = string_map_create()
+    };
+
+    // Chunks are written first, since they determine the contents of the other tables.
+    write_chunks(&writer, mod);
+
+    for (size_t i = 0; i < BINARY_MAGIC_SIZE; ++i)
+        write_byte(&writer.bytes, (uint8_t)BINARY_MAGIC[i]);
+    write_varint(&writer.bytes, BINARY_VERSION);
+    write_string(&writer.bytes, str_view_from(fir_mod_name(mod)));
+    write_dbg_infos(&writer);
+    write_tables(&writer, mod);
+
+    // Modules without nominal nodes have no chunks, in which case the chunk buffer is never allocated.
+    bool status =
+        fwrite(writer.bytes.elems, 1, writer.bytes.elem_count, file) == writer.bytes.elem_count &&
+        (writer.chunk_bytes.elem_count == 0 ||
+            fwrite(writer.chunk_bytes.elems, 1, writer.chunk_bytes.elem_count, file) == writer.chunk_bytes.elem_count);
+
+    string_map_destroy(&writer.string_indices);
+    str_view_vec_destroy(&writer.strings);
+    dbg_info_map_destroy(&writer.dbg_info_indices);
+    dbg_info_vec_destroy(&writer.dbg_infos);
+    node_array_map_destroy(&writer.slot_indices);
+    node_slot_vec_destroy(&writer.slots);
+    node_vec_destroy(&writer.type_stack);
+    node_vec_destroy(&writer.stack);
+    node_vec_destroy(&writer.chunk_nodes);
+    node_vec_destroy(&writer.nominal_nodes);
+    node_vec_destroy(&writer.types);
+    size_vec_destroy(&writer.chunk_sizes);
+    byte_vec_destroy(&writer.chunk_bytes);
+    byte_vec_destroy(&writer.bytes);
+    return status;
+}
+
+struct binary_reader {
+    const uint8_t* cur;
+    const uint8_t* end;
+    bool is_valid;
+};
+
+struct binary_loader {
+    struct fir_mod* mod;
+    char* file_name;
+    FILE* error_log;
+    void* mapped_data;
+    size_t mapped_size;
+    const uint8_t* chunk_data;
+    struct size_vec chunk_offsets;
+    struct dbg_info_vec dbg_infos;
+    struct node_vec types;
+    struct node_vec nominal_nodes;
+    struct lazy_func_map lazy_funcs;
+    size_t lazy_func_count;
+    bool is_attached;
+    struct node_vec chunk_nodes;
+    struct node_vec ops;
+    struct node_vec pending_funcs;
+};
+
+static uint8_t read_byte(struct binary_reader* reader) {
+    if (reader->cur == reader->end) {
+        reader->is_valid = false;
+        return 0;
+    }
+    return *(reader->cur++);
+}
+
+static uint64_t read_varint(struct binary_reader* reader) {
+    uint64_t val = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = read_byte(reader);
+        val |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return val;
+    }
+    reader->is_valid = false;
+    return 0;
+}
+
+static size_t read_index(struct binary_reader* reader, size_t count) {
+    uint64_t index = read_varint(reader);
+    if (index >= count) {
+        reader->is_valid = false;
+        return 0;
+    }
+    return index;
+}
+
+static size_t read_count(struct binary_reader* reader) {
+    // Every element takes at least one byte, which bounds the number of elements.
+    uint64_t count = read_varint(reader);
+    if (count > (uint64_t)(reader->end - reader->cur)) {
+        reader->is_valid = false;
+        return 0;
+    }
+    return count;
+}
+
+static struct str_view read_string(struct binary_reader* reader) {
+    uint64_t length = read_varint(reader);
+    if (length > (uint64_t)(reader->end - reader->cur)) {
+        reader->is_valid = false;
+        return (struct str_view) {};
+    }
+    struct str_view str = { .data = (const char*)reader->cur, .length = length };
+    reader->cur += length;
+    return str;
+}
+
+static const struct fir_node* read_node_ref(
+    struct binary_reader* reader,
+    struct binary_loader* loader,
+    size_t node_index)
+{
+    uint64_t ref = read_varint(reader);
+    if (ref-- == 0)
+        return NULL;
+
+    uint64_t index = ref >> NODE_REF_KIND_BITS;
+    switch (ref & ((1 << NODE_REF_KIND_BITS) - 1)) {
+        case NODE_REF_LOCAL:
+            if (index == 0 || index > node_index)
+                break;
+            return loader->chunk_nodes.elems[node_index - index];
+        case NODE_REF_TYPE:
+            if (index >= loader->types.elem_count)
+                break;
+            return loader->types.elems[index];
+        case NODE_REF_NOMINAL: {
+            if (index >= loader->nominal_nodes.elem_count)
+                break;
+            const struct fir_node* node = loader->nominal_nodes.elems[index];
+            if ((node->props & FIR_PROP_LAZY) && fir_node_is_cont_ty(node->ty))
+                node_vec_push(&loader->pending_funcs, &node);
+            return node;
+        }
+        default:
+            break;
+    }
+    reader->is_valid = false;
+    return NULL;
+}
+
+static const struct fir_node* read_ty_ref(struct binary_reader* reader, struct binary_loader* loader) {
+    const struct fir_node* ty = read_node_ref(reader, loader, 0);
+    if (!ty || !fir_node_is_ty(ty)) {
+        reader->is_valid = false;
+        return NULL;
+    }
+    return ty;
+}
+
+static struct fir_source_pos read_source_pos(struct binary_reader* reader) {
+    return (struct fir_source_pos) {
+        .row = read_varint(reader),
+        .col = read_varint(reader),
+        .bytes = read_varint(reader)
+    };
+}
+
+static void read_dbg_infos(
+    struct binary_reader* reader,
+    struct binary_loader* loader,
+    struct fir_dbg_info_pool* dbg_pool)
+{
+    struct str_view_vec strings = str_view_vec_create();
+    for (size_t i = 0, n = read_varint(reader); i < n && reader->is_valid; ++i) {
+        struct str_view str = read_string(reader);
+        str_view_vec_push(&strings, &str);
+    }
+    for (size_t i = 0, n = read_varint(reader); i < n && reader->is_valid; ++i) {
+        size_t name_index = read_index(reader, strings.elem_count);
+        size_t file_name_index = read_index(reader, strings.elem_count);
+        struct fir_source_range source_range = {
+            .begin = read_source_pos(reader),
+            .end = read_source_pos(reader)
+        };
+        if (!reader->is_valid)
+            break;
+        struct str_view name = strings.elems[name_index];
+        struct str_view file_name = strings.elems[file_name_index];
+        const struct fir_dbg_info* dbg_info = dbg_pool
+            ? fir_dbg_info_with_length(dbg_pool,
+                name.data, name.length, file_name.data, file_name.length, source_range)
+            : NULL;
+        dbg_info_vec_push(&loader->dbg_infos, &dbg_info);
+    }
+    str_view_vec_destroy(&strings);
+}
+
+static union fir_node_data read_node_data(
+    struct binary_reader* reader,
+    enum fir_node_tag tag,
+    const struct fir_node* ty)
+{
+    union fir_node_data data = {};
+    if (tag == FIR_FUNC)
+        data.func_flags = read_varint(reader);
+    else if (fir_node_tag_has_mem_flags(tag))
+        data.mem_flags = read_varint(reader);
+    else if (fir_node_tag_has_fp_flags(tag))
+        data.fp_flags = read_varint(reader);
+    else if (tag == FIR_ARRAY_TY)
+        data.array_dim = read_varint(reader);
+    else if (tag == FIR_CONST && ty->tag == FIR_INT_TY)
+        data.int_val = read_varint(reader);
+    else if (tag == FIR_CONST && ty->tag == FIR_FLOAT_TY) {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < sizeof(bits); ++i)
+            bits |= (uint64_t)read_byte(reader) << (i * 8);
+        memcpy(&data.float_val, &bits, sizeof(bits));
+    } else if (fir_node_tag_has_bitwidth(tag))
+        data.bitwidth = read_varint(reader);
+    return data;
+}
+
+struct node_record {
+    enum fir_node_tag tag;
+    uint64_t flags;
+    const struct fir_dbg_info* dbg_info;
+};
+
+static bool read_node_record(struct binary_reader* reader, struct binary_loader* loader, struct node_record* record) {
+    uint8_t tag = read_byte(reader);
+    record->tag = tag;
+    record->flags = read_varint(reader);
+    record->dbg_info = NULL;
+    if (record->flags & NODE_RECORD_HAS_DBG_INFO) {
+        size_t dbg_info_index = read_index(reader, loader->dbg_infos.elem_count);
+        if (reader->is_valid)
+            record->dbg_info = loader->dbg_infos.elems[dbg_info_index];
+    }
+    return reader->is_valid && tag < FIR_NODE_TAG_COUNT;
+}
+
+static bool read_ops(struct binary_reader* reader, struct binary_loader* loader, size_t node_index) {
+    size_t op_count = read_count(reader);
+    node_vec_resize(&loader->ops, op_count);
+    for (size_t i = 0; i < op_count; ++i) {
+        loader->ops.elems[i] = read_node_ref(reader, loader, node_index);
+        reader->is_valid &= loader->ops.elems[i] != NULL;
+    }
+    return reader->is_valid;
+}
+
+// The node constructors only check their preconditions with assertions, so the operands of every
+// node are checked against them before rebuilding it. The following functions mirror these
+// preconditions, and reject the nodes that `fir_node_rebuild` cannot build.
+
+static inline bool is_valid_elem_ty(const struct fir_node* ty) {
+    return fir_node_is_ty(ty) && ty->tag != FIR_NORET_TY;
+}
+
+static inline bool is_valid_pointee_ty(const struct fir_node* ty) {
+    return is_valid_elem_ty(ty) && ty->tag != FIR_MEM_TY;
+}
+
+static bool are_valid_ty_ops(
+    enum fir_node_tag tag,
+    const struct fir_node* const* ops,
+    size_t op_count)
+{
+    switch (tag) {
+        case FIR_TUP_TY:
+            for (size_t i = 0; i < op_count; ++i) {
+                if (!is_valid_elem_ty(ops[i]))
+                    return false;
+            }
+            return true;
+        case FIR_ARRAY_TY:
+        case FIR_DYNARRAY_TY:
+            return op_count == 1 && is_valid_elem_ty(ops[0]);
+        case FIR_FUNC_TY:
+            return op_count == 2 && is_valid_elem_ty(ops[0]) && fir_node_is_ty(ops[1]);
+        default:
+            return op_count == 0;
+    }
+}
+
+static const struct fir_node* find_ext_ty(const struct fir_node* aggr_ty, const struct fir_node* index) {
+    if (index->ty->tag != FIR_INT_TY)
+        return NULL;
+    bool is_const = index->tag == FIR_CONST;
+    if (aggr_ty->tag == FIR_TUP_TY && is_const && index->data.int_val < aggr_ty->op_count)
+        return aggr_ty->ops[index->data.int_val];
+    if (aggr_ty->tag == FIR_ARRAY_TY && (!is_const || index->data.int_val < aggr_ty->data.array_dim))
+        return aggr_ty->ops[0];
+    return NULL;
+}
+
+static bool is_valid_cast(enum fir_node_tag tag, const struct fir_node* ty, const struct fir_node* arg_ty) {
+    bool is_int = ty->tag == FIR_INT_TY;
+    bool is_arg_int = arg_ty->tag == FIR_INT_TY;
+    if ((!is_int && ty->tag != FIR_FLOAT_TY) || (!is_arg_int && arg_ty->tag != FIR_FLOAT_TY))
+        return false;
+    switch (tag) {
+        case FIR_BITCAST:
+            return arg_ty->data.bitwidth == ty->data.bitwidth;
+        case FIR_UTOF:
+        case FIR_STOF:
+            return is_arg_int && !is_int;
+        case FIR_FTOU:
+        case FIR_FTOS:
+            return !is_arg_int && is_int;
+        case FIR_ZEXT:
+        case FIR_SEXT:
+            return is_arg_int && is_int && arg_ty->data.bitwidth <= ty->data.bitwidth;
+        case FIR_ITRUNC:
+            return is_arg_int && is_int && arg_ty->data.bitwidth >= ty->data.bitwidth;
+        case FIR_FTRUNC:
+            return !is_arg_int && !is_int && arg_ty->data.bitwidth >= ty->data.bitwidth;
+        default:
+            return false;
+    }
+}
+
+static bool is_valid_start(const struct fir_node* block) {
+    if (block->tag != FIR_FUNC || !fir_node_is_cont_ty(block->ty))
+        return false;
+    const struct fir_node* param_ty = FIR_FUNC_TY_PARAM(block->ty);
+    return
+        param_ty->tag == FIR_TUP_TY &&
+        param_ty->op_count == 2 &&
+        param_ty->ops[0]->tag == FIR_FRAME_TY &&
+        fir_node_is_cont_ty(param_ty->ops[1]);
+}
+
+static bool are_valid_ops(
+    enum fir_node_tag tag,
+    const struct fir_node* ty,
+    const struct fir_node* const* ops,
+    size_t op_count)
+{
+    // The aggregate type of `addrof` is the only operand that is a type.
+    for (size_t i = 0; i < op_count; ++i) {
+        if (fir_node_is_ty(ops[i]) != (tag == FIR_ADDROF && i == 1))
+            return false;
+    }
+
+    if (fir_node_tag_is_iarith_op(tag) || fir_node_tag_is_icmp_op(tag) || fir_node_tag_is_bit_op(tag))
+        return op_count == 2 && ops[0]->ty == ops[1]->ty && ops[0]->ty->tag == FIR_INT_TY;
+    if (fir_node_tag_is_farith_op(tag) || fir_node_tag_is_fcmp_op(tag))
+        return op_count == 2 && ops[0]->ty == ops[1]->ty && ops[0]->ty->tag == FIR_FLOAT_TY;
+    if (fir_node_tag_is_cast_op(tag))
+        return op_count == 1 && is_valid_cast(tag, ty, ops[0]->ty);
+
+    switch (tag) {
+        case FIR_TOP:
+        case FIR_BOT:
+            return op_count == 0 && is_valid_elem_ty(ty);
+        case FIR_CONST:
+            return op_count == 0 && (ty->tag == FIR_INT_TY || ty->tag == FIR_FLOAT_TY);
+        case FIR_TUP:
+            for (size_t i = 0; i < op_count; ++i) {
+                if (!is_valid_elem_ty(ops[i]->ty))
+                    return false;
+            }
+            return true;
+        case FIR_ARRAY:
+            if (ty->tag != FIR_ARRAY_TY || op_count != ty->data.array_dim)
+                return false;
+            for (size_t i = 0; i < op_count; ++i) {
+                if (ops[i]->ty != ty->ops[0])
+                    return false;
+            }
+            return true;
+        case FIR_EXT:
+            return op_count == 2 && find_ext_ty(ops[0]->ty, ops[1]);
+        case FIR_INS:
+            return op_count == 3 && find_ext_ty(ops[0]->ty, ops[1]) == ops[2]->ty;
+        case FIR_ADDROF:
+            return op_count == 3 && ops[0]->ty->tag == FIR_PTR_TY && find_ext_ty(ops[1], ops[2]);
+        case FIR_LOAD:
+            return
+                op_count == 2 &&
+                ops[0]->ty->tag == FIR_MEM_TY &&
+                ops[1]->ty->tag == FIR_PTR_TY &&
+                ty->tag == FIR_TUP_TY &&
+                ty->op_count == 2 &&
+                ty->ops[0]->tag == FIR_MEM_TY &&
+                is_valid_pointee_ty(ty->ops[1]);
+        case FIR_STORE:
+            return
+                op_count == 3 &&
+                ops[0]->ty->tag == FIR_MEM_TY &&
+                ops[1]->ty->tag == FIR_PTR_TY &&
+                is_valid_pointee_ty(ops[2]->ty);
+        case FIR_CALL:
+            return op_count == 2 && ops[0]->ty->tag == FIR_FUNC_TY && FIR_FUNC_TY_PARAM(ops[0]->ty) == ops[1]->ty;
+        case FIR_PARAM:
+        case FIR_CTRL:
+            return op_count == 1 && ops[0]->tag == FIR_FUNC;
+        case FIR_START:
+            return op_count == 1 && is_valid_start(ops[0]);
+        default:
+            return false;
+    }
+}
+
+static const struct fir_node* rebuild_node(
+    struct binary_loader* loader,
+    const struct node_record* record,
+    const union fir_node_data* data,
+    const struct fir_node* ctrl,
+    const struct fir_node* ty)
+{
+    const struct fir_node* node = fir_node_rebuild(loader->mod,
+        record->tag, data, ctrl, ty, loader->ops.elems, loader->ops.elem_count);
+    if (node && record->dbg_info)
+        fir_node_set_dbg_info(node, record->dbg_info);
+    return node;
+}
+
+static void read_types(struct binary_reader* reader, struct binary_loader* loader) {
+    // Types only refer to the types that precede them in the type table.
+    for (size_t i = 0, n = read_count(reader); i < n && reader->is_valid; ++i) {
+        struct node_record record;
+        if (!read_node_record(reader, loader, &record) || !fir_node_tag_is_ty(record.tag)) {
+            reader->is_valid = false;
+            break;
+        }
+        union fir_node_data data = read_node_data(reader, record.tag, NULL);
+        if (!read_ops(reader, loader, 0))
+            break;
+        for (size_t j = 0; j < loader->ops.elem_count; ++j)
+            reader->is_valid &= fir_node_is_ty(loader->ops.elems[j]);
+        reader->is_valid &= are_valid_ty_ops(record.tag, loader->ops.elems, loader->ops.elem_count);
+        const struct fir_node* ty = reader->is_valid ? rebuild_node(loader, &record, &data, NULL, NULL) : NULL;
+        reader->is_valid &= ty != NULL;
+        node_vec_push(&loader->types, &ty);
+    }
+}
+
+static void read_nominal_nodes(struct binary_reader* reader, struct binary_loader* loader) {
+    for (size_t i = 0, n = read_count(reader); i < n && reader->is_valid; ++i) {
+        struct node_record record;
+        if (!read_node_record(reader, loader, &record) || !fir_node_tag_is_nominal(record.tag)) {
+            reader->is_valid = false;
+            break;
+        }
+        const struct fir_node* ty = read_ty_ref(reader, loader);
+        if (!reader->is_valid || (record.tag == FIR_FUNC && ty->tag != FIR_FUNC_TY)) {
+            reader->is_valid = false;
+            break;
+        }
+        union fir_node_data data = read_node_data(reader, record.tag, ty);
+        struct fir_node* node = fir_node_clone(loader->mod, &(struct fir_node) { .tag = record.tag, .data = data }, ty);
+        if (record.dbg_info)
+            fir_node_set_dbg_info(node, record.dbg_info);
+        node_vec_push(&loader->nominal_nodes, (const struct fir_node**)&node);
+    }
+}
+
+static void read_externals(struct binary_reader* reader, struct binary_loader* loader) {
+    for (size_t i = 0, n = read_varint(reader); i < n && reader->is_valid; ++i) {
+        size_t node_index = read_index(reader, loader->nominal_nodes.elem_count);
+        if (!reader->is_valid)
+            break;
+        struct fir_node* node = (struct fir_node*)loader->nominal_nodes.elems[node_index];
+        if (!fir_node_can_be_external(node) || fir_node_is_external(node)) {
+            reader->is_valid = false;
+            break;
+        }
+        fir_node_make_external(node);
+    }
+}
+
+static void read_chunk_offsets(struct binary_reader* reader, struct binary_loader* loader) {
+    // The chunks start after the table of sizes, so the sizes can only be checked against the
+    // remaining data once the whole table has been read. Until then, only overflows are rejected.
+    size_t chunk_offset = 0;
+    size_vec_push(&loader->chunk_offsets, &chunk_offset);
+    for (size_t i = 0; i < loader->nominal_nodes.elem_count && reader->is_valid; ++i) {
+        uint64_t chunk_size = read_varint(reader);
+        if (chunk_size > SIZE_MAX - chunk_offset) {
+            reader->is_valid = false;
+            break;
+        }
+        chunk_offset += chunk_size;
+        size_vec_push(&loader->chunk_offsets, &chunk_offset);
+    }
+    loader->chunk_data = reader->cur;
+    reader->is_valid &= chunk_offset == (size_t)(reader->end - reader->cur);
+}
+
+static const struct fir_node* read_chunk_node(
+    struct binary_reader* reader,
+    struct binary_loader* loader,
+    size_t node_index)
+{
+    struct node_record record;
+    if (!read_node_record(reader, loader, &record) ||
+        fir_node_tag_is_ty(record.tag) ||
+        fir_node_tag_is_nominal(record.tag))
+        return NULL;
+
+    const struct fir_node* ty = read_ty_ref(reader, loader);
+    const struct fir_node* ctrl = (record.flags & NODE_RECORD_HAS_CTRL) ? read_node_ref(reader, loader, node_index) : NULL;
+    if (!reader->is_valid ||
+        ((record.flags & NODE_RECORD_HAS_CTRL) &&
+            (!ctrl || fir_node_is_ty(ctrl) || ctrl->ty->tag != FIR_CTRL_TY)))
+        return NULL;
+
+    union fir_node_data data = read_node_data(reader, record.tag, ty);
+    if (!read_ops(reader, loader, node_index) ||
+        !are_valid_ops(record.tag, ty, loader->ops.elems, loader->ops.elem_count))
+        return NULL;
+    const struct fir_node* node = rebuild_node(loader, &record, &data, ctrl, ty);
+    return node->ty == ty ? node : NULL;
+}
+
+static bool is_valid_nominal_op(const struct fir_node* node, size_t op_index, const struct fir_node* op) {
+    if (fir_node_is_ty(op))
+        return false;
+    // Functions that are not continuations must start with `start`, which their analyses rely on.
+    if (node->tag == FIR_FUNC)
+        return op->ty == FIR_FUNC_TY_RET(node->ty) && (fir_node_is_cont_ty(node->ty) || op->tag == FIR_START);
+    if (node->tag == FIR_LOCAL && op_index == 0)
+        return op->ty->tag == FIR_FRAME_TY;
+    return true;
+}
+
+static bool read_chunk(struct binary_loader* loader, size_t chunk_index) {
+    struct binary_reader reader = {
+        .cur = loader->chunk_data + loader->chunk_offsets.elems[chunk_index],
+        .end = loader->chunk_data + loader->chunk_offsets.elems[chunk_index + 1],
+        .is_valid = true
+    };
+    if (reader.cur == reader.end)
+        return true;
+
+    size_t node_count = read_count(&reader);
+    node_vec_clear(&loader->chunk_nodes);
+    for (size_t i = 0; i < node_count && reader.is_valid; ++i) {
+        const struct fir_node* node = read_chunk_node(&reader, loader, i);
+        reader.is_valid &= node != NULL;
+        node_vec_push(&loader->chunk_nodes, &node);
+    }
+
+    struct fir_node* nominal_node = (struct fir_node*)loader->nominal_nodes.elems[chunk_index];
+    for (size_t i = 0; i < nominal_node->op_count && reader.is_valid; ++i) {
+        const struct fir_node* op = read_node_ref(&reader, loader, node_count);
+        reader.is_valid &= !op || is_valid_nominal_op(nominal_node, i, op);
+        if (op && reader.is_valid)
+            fir_node_set_op(nominal_node, i, op);
+    }
+    return reader.is_valid && reader.cur == reader.end;
+}
+
+static struct binary_loader* create_loader(
+    struct fir_mod* mod,
+    const struct fir_binary_input* input,
+    void* mapped_data)
+{
+    struct binary_loader* loader = xcalloc(1, sizeof(struct binary_loader));
+    loader->mod = mod;
+    loader->file_name = strdup(input->file_name ? input->file_name : "");
+    loader->error_log = input->error_log;
+    loader->mapped_data = mapped_data;
+    loader->mapped_size = input->data_size;
+    loader->chunk_offsets = size_vec_create();
+    loader->dbg_infos = dbg_info_vec_create();
+    loader->types = node_vec_create();
+    loader->nominal_nodes = node_vec_create();
+    loader->lazy_funcs = lazy_func_map_create();
+    loader->chunk_nodes = node_vec_create();
+    loader->ops = node_vec_create();
+    loader->pending_funcs = node_vec_create();
+    return loader;
+}
+
+void binary_loader_destroy(struct binary_loader* loader) {
+    if (loader->mapped_data)
+        munmap(loader->mapped_data, loader->mapped_size);
+    free(loader->file_name);
+    size_vec_destroy(&loader->chunk_offsets);
+    dbg_info_vec_destroy(&loader->dbg_infos);
+    node_vec_destroy(&loader->types);
+    node_vec_destroy(&loader->nominal_nodes);
+    lazy_func_map_destroy(&loader->lazy_funcs);
+    node_vec_destroy(&loader->chunk_nodes);
+    node_vec_destroy(&loader->ops);
+    node_vec_destroy(&loader->pending_funcs);
+    free(loader);
+}
+
+size_t binary_loader_lazy_func_count(const struct binary_loader* loader) {
+    return loader->lazy_func_count;
+}
+
+const struct fir_node* const* binary_loader_types(const struct binary_loader* loader, size_t* type_count) {
+    *type_count = loader->types.elem_count;
+    return loader->types.elems;
+}
+
+size_t binary_loader_materialize(struct binary_loader* loader, struct fir_node* func) {
+    // Continuations are only meaningful along with the function that they belong to, which is why
+    // they are materialized together.
+    size_t func_count = 0;
+    bool is_valid = true;
+    node_vec_clear(&loader->pending_funcs);
+    node_vec_push(&loader->pending_funcs, (const struct fir_node**)&func);
+    while (!node_vec_is_empty(&loader->pending_funcs)) {
+        struct fir_node* pending_func = (struct fir_node*)*node_vec_pop(&loader->pending_funcs);
+        if (!(pending_func->props & FIR_PROP_LAZY))
+            continue;
+
+        const size_t* chunk_index = lazy_func_map_find(&loader->lazy_funcs, (const struct fir_node**)&pending_func);
+        assert(chunk_index);
+        pending_func->props &= ~FIR_PROP_LAZY;
+        loader->lazy_func_count--;
+        func_count++;
+
+        if (!read_chunk(loader, *chunk_index)) {
+            is_valid = false;
+            if (loader->error_log) {
+                fprintf(loader->error_log, "'%s' contains an invalid body for function '%s'\n",
+                    loader->file_name, fir_node_name(pending_func));
+            }
+        }
+    }
+
+    // The continuations that were read successfully may jump to one that was not. Removing the
+    // body of the function makes sure that none of them can be reached.
+    if (!is_valid)
+        fir_node_set_op(func, 0, NULL);
+    return func_count;
+}
+
+size_t binary_loader_materialize_all(struct binary_loader* loader) {
+    size_t func_count = 0;
+    for (size_t i = 0; i < loader->nominal_nodes.elem_count && loader->lazy_func_count > 0; ++i) {
+        struct fir_node* node = (struct fir_node*)loader->nominal_nodes.elems[i];
+        if (node->props & FIR_PROP_LAZY)
+            func_count += binary_loader_materialize(loader, node);
+    }
+    return func_count;
+}
+
+static bool read_header(struct binary_reader* reader, struct binary_loader* loader, const struct fir_binary_input* input) {
+    if (input->data_size < BINARY_MAGIC_SIZE || memcmp(input->data, BINARY_MAGIC, BINARY_MAGIC_SIZE)) {
+        if (input->error_log)
+            fprintf(input->error_log, "'%s' is not a binary module\n", input->file_name);
+        reader->is_valid = false;
+        return false;
+    }
+    reader->cur += BINARY_MAGIC_SIZE;
+
+    uint64_t version = read_varint(reader);
+    if (version != BINARY_VERSION) {
+        if (input->error_log) {
+            fprintf(input->error_log, "'%s' uses binary format version %"PRIu64", but only version %d is supported\n",
+                input->file_name, version, BINARY_VERSION);
+        }
+        reader->is_valid = false;
+        return false;
+    }
+
+    struct str_view name = read_string(reader);
+    if (reader->is_valid)
+        fir_mod_set_name_with_length(loader->mod, name.data, name.length);
+    read_dbg_infos(reader, loader, input->dbg_pool);
+    if (reader->is_valid)
+        read_types(reader, loader);
+    if (reader->is_valid)
+        read_nominal_nodes(reader, loader);
+    if (reader->is_valid)
+        read_externals(reader, loader);
+    if (reader->is_valid)
+        read_chunk_offsets(reader, loader);
+    if (!reader->is_valid && input->error_log)
+        fprintf(input->error_log, "'%s' is not a valid binary module\n", input->file_name);
+    return reader->is_valid;
+}
+
+static bool read_binary(struct fir_mod* mod, const struct fir_binary_input* input, void* mapped_data) {
+    struct binary_loader* loader = create_loader(mod, input, mapped_data);
+    struct binary_reader reader = {
+        .cur = input->data,
+        .end = (const uint8_t*)input->data + input->data_size,
+        .is_valid = true
+    };
+
+    // Materializing a function modifies the loader and the function itself without any locking,
+    // and may happen on any thread that accesses its body. Concurrent modules are therefore always
+    // loaded eagerly.
+    bool is_lazy = input->is_lazy && !fir_mod_is_concurrent(mod);
+    bool status = read_header(&reader, loader, input);
+    if (status && is_lazy) {
+        VEC_FOREACH(const struct fir_node*, node_ptr, loader->nominal_nodes) {
+            size_t chunk_index = node_ptr - loader->nominal_nodes.elems;
+            if ((*node_ptr)->tag != FIR_FUNC ||
+                loader->chunk_offsets.elems[chunk_index] == loader->chunk_offsets.elems[chunk_index + 1])
+                continue;
+            ((struct fir_node*)*node_ptr)->props |= FIR_PROP_LAZY;
+            lazy_func_map_insert(&loader->lazy_funcs, node_ptr, &chunk_index);
+            loader->lazy_func_count++;
+        }
+        // The loader is attached before reading the other chunks, which may need to materialize
+        // lazy functions.
+        if (loader->lazy_func_count > 0) {
+            mod_set_binary_loader(mod, loader);
+            loader->is_attached = true;
+        }
+    }
+    for (size_t i = 0; i < loader->nominal_nodes.elem_count && status; ++i) {
+        if (!(loader->nominal_nodes.elems[i]->props & FIR_PROP_LAZY))
+            status &= read_chunk(loader, i);
+    }
+    if (!status) {
+        if (reader.is_valid && input->error_log)
+            fprintf(input->error_log, "'%s' is not a valid binary module\n", input->file_name);
+        VEC_FOREACH(const struct fir_node*, node_ptr, loader->nominal_nodes) {
+            ((struct fir_node*)*node_ptr)->props &= ~FIR_PROP_LAZY;
+        }
+        loader->lazy_func_count = 0;
+    }
+
+    // Materializing a module without lazy functions releases its loader.
+    if (!loader->is_attached)
+        binary_loader_destroy(loader);
+    else if (loader->lazy_func_count == 0)
+        fir_mod_materialize(mod);
+    return status;
+}
+
+bool fir_mod_read_binary(struct fir_mod* mod, const struct fir_binary_input* input) {
+    return read_binary(mod, input, NULL);
+}
+
+bool fir_mod_read_binary_file(
+    struct fir_mod* mod,
+    const char* file_name,
+    FILE* error_log,
+    struct fir_dbg_info_pool* dbg_pool,
+    bool is_lazy)
+{
+    int fd = open(file_name, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        if (fd >= 0)
+            close(fd);
+        if (error_log)
+            fprintf(error_log, "cannot open file '%s'\n", file_name);
+        return false;
+    }
+
+    // Mapping an empty file is not allowed, but an empty file is not a valid module anyway.
+    size_t data_size = file_stat.st_size;
+    void* data = data_size > 0 ? mmap(NULL, data_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) {
+        if (error_log)
+            fprintf(error_log, "cannot map file '%s'\n", file_name);
+        return false;
+    }
+
+    // The mapping is released along with the loader, once every function has been materialized.
+    return read_binary(mod, &(struct fir_binary_input) {
+        .file_name = file_name,
+        .data = data,
+        .data_size = data_size,
+        .error_log = error_log,
+        .dbg_pool = dbg_pool,
+        .is_lazy = is_lazy
+    }, data);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+struct fir_mod;
+struct fir_node;
+
+// Loads the bodies of the functions of a binary module on demand (see `fir_mod_read_binary`). A
+// loader is owned by the module it loads functions into. As long as some functions are lazy, the
+// module must keep every nominal node alive, as well as the types returned by
+// `binary_loader_types`, since the bodies that are not loaded yet may refer to them.
+struct binary_loader;
+
+void binary_loader_destroy(struct binary_loader*);
+
+size_t binary_loader_lazy_func_count(const struct binary_loader*);
+const struct fir_node* const* binary_loader_types(const struct binary_loader*, size_t* type_count);
+
+// Materializes the body of the given lazy function, as well as the lazy continuations it refers
+// to. Returns the number of functions that were materialized.
+size_t binary_loader_materialize(struct binary_loader*, struct fir_node* func);
+size_t binary_loader_materialize_all(struct binary_loader*);
+
+// Attaches a loader to a module, which becomes responsible for destroying it. This is defined in
+// the module implementation.
+void mod_set_binary_loader(struct fir_mod*, struct binary_loader*);
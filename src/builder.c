@@ -0,0 +1,48 @@
+#include "fir/module.h"
+
+#include "import.h"
+
+#include <overture/mem.h>
+
+#include <stdlib.h>
+
+struct fir_mod_builder {
+    struct fir_mod* mod;
+    struct fir_mod* private_mod;
+    struct node_importer importer;
+};
+
+struct fir_mod_builder* fir_mod_builder_create(struct fir_mod* mod) {
+    struct fir_mod_builder* builder = xmalloc(sizeof(struct fir_mod_builder));
+    builder->mod = mod;
+    builder->private_mod = fir_mod_create(fir_mod_name(mod));
+    builder->importer = node_importer_create(mod);
+    return builder;
+}
+
+void fir_mod_builder_destroy(struct fir_mod_builder* builder) {
+    node_importer_destroy(&builder->importer);
+    fir_mod_destroy(builder->private_mod);
+    free(builder);
+}
+
+struct fir_mod* fir_mod_builder_mod(struct fir_mod_builder* builder) {
+    return builder->private_mod;
+}
+
+void fir_mod_builder_commit(struct fir_mod_builder* builder) {
+    struct fir_node* const* funcs = fir_mod_funcs(builder->private_mod);
+    struct fir_node* const* globals = fir_mod_globals(builder->private_mod);
+    for (size_t i = 0, n = fir_mod_func_count(builder->private_mod); i < n; ++i)
+        node_importer_import(&builder->importer, funcs[i]);
+    for (size_t i = 0, n = fir_mod_global_count(builder->private_mod); i < n; ++i)
+        node_importer_import(&builder->importer, globals[i]);
+    node_importer_finish(&builder->importer);
+}
+
+const struct fir_node* fir_mod_builder_find(
+    const struct fir_mod_builder* builder,
+    const struct fir_node* node)
+{
+    return node_importer_find(&builder->importer, node);
+}
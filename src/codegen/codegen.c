@@ -33,5 +33,6 @@ bool fir_codegen_run(
     struct fir_mod* mod,
     const char* output_file)
 {
+    fir_mod_materialize(mod);
     return codegen->run(codegen, mod, output_file);
 }
@@ -2,8 +2,13 @@
 
 #include "fir/node.h"
 
+#include <overture/mem.h>
+
+#include <assert.h>
+#include <string.h>
+
 static inline uint32_t hash_node(uint32_t h, const struct fir_node* const* node_ptr) {
-    return hash_uint64(h, (*node_ptr)->id);
+    return hash_uint32(h, (*node_ptr)->id);
 }
 
 static inline bool is_node_equal(
@@ -14,7 +19,7 @@ static inline bool is_node_equal(
 }
 
 static inline uint32_t hash_use(uint32_t h, const struct fir_use* const* use_ptr) {
-    return hash_uint64(hash_uint64(h, (*use_ptr)->index), (*use_ptr)->user->id);
+    return hash_uint32(hash_uint64(h, (*use_ptr)->index), (*use_ptr)->user->id);
 }
 
 static inline uint32_t is_use_equal(
@@ -34,3 +39,105 @@ VEC_IMPL(node_vec, const struct fir_node*, PUBLIC)
 SMALL_VEC_IMPL(small_node_vec, const struct fir_node*, PUBLIC)
 MAP_IMPL(use_map, const struct fir_use*, void*, hash_use, is_use_equal, PUBLIC)
 UNIQUE_STACK_IMPL(unique_node_stack, const struct fir_node*, hash_node, is_node_equal, PUBLIC)
+
+#define NODE_ARRAY_MAP_PAGE_SIZE 512
+#define NODE_BITSET_PAGE_SIZE 64
+
+struct node_array_map node_array_map_create(void) {
+    return (struct node_array_map) {};
+}
+
+void node_array_map_destroy(struct node_array_map* map) {
+    for (size_t i = 0; i < map->page_count; ++i)
+        free(map->pages[i]);
+    free(map->pages);
+}
+
+void node_array_map_clear(struct node_array_map* map) {
+    for (size_t i = 0; i < map->page_count; ++i) {
+        if (map->pages[i])
+            memset(map->pages[i], 0, sizeof(void*) * NODE_ARRAY_MAP_PAGE_SIZE);
+    }
+}
+
+void* const* node_array_map_find(const struct node_array_map* map, const struct fir_node* node) {
+    size_t page_index = node->id / NODE_ARRAY_MAP_PAGE_SIZE;
+    if (page_index >= map->page_count || !map->pages[page_index])
+        return NULL;
+    void* const* val = &map->pages[page_index][node->id % NODE_ARRAY_MAP_PAGE_SIZE];
+    return *val ? val : NULL;
+}
+
+bool node_array_map_insert(struct node_array_map* map, const struct fir_node* node, void* val) {
+    assert(val);
+    size_t page_index = node->id / NODE_ARRAY_MAP_PAGE_SIZE;
+    if (page_index >= map->page_count) {
+        size_t page_count = page_index + 1 > map->page_count * 2 ? page_index + 1 : map->page_count * 2;
+        map->pages = xrealloc(map->pages, sizeof(void**) * page_count);
+        memset(map->pages + map->page_count, 0, sizeof(void**) * (page_count - map->page_count));
+        map->page_count = page_count;
+    }
+    if (!map->pages[page_index])
+        map->pages[page_index] = xcalloc(NODE_ARRAY_MAP_PAGE_SIZE, sizeof(void*));
+    void** stored_val = &map->pages[page_index][node->id % NODE_ARRAY_MAP_PAGE_SIZE];
+    if (*stored_val)
+        return false;
+    *stored_val = val;
+    return true;
+}
+
+struct node_bitset node_bitset_create(void) {
+    return (struct node_bitset) {};
+}
+
+void node_bitset_destroy(struct node_bitset* bitset) {
+    for (size_t i = 0; i < bitset->page_count; ++i)
+        free(bitset->pages[i]);
+    free(bitset->pages);
+}
+
+void node_bitset_clear(struct node_bitset* bitset) {
+    for (size_t i = 0; i < bitset->page_count; ++i) {
+        if (bitset->pages[i])
+            memset(bitset->pages[i], 0, sizeof(uint64_t) * NODE_BITSET_PAGE_SIZE);
+    }
+}
+
+static inline uint64_t* find_node_bitset_word(const struct node_bitset* bitset, const struct fir_node* node) {
+    size_t page_index = node->id / (NODE_BITSET_PAGE_SIZE * 64);
+    if (page_index >= bitset->page_count || !bitset->pages[page_index])
+        return NULL;
+    return &bitset->pages[page_index][(node->id / 64) % NODE_BITSET_PAGE_SIZE];
+}
+
+bool node_bitset_find(const struct node_bitset* bitset, const struct fir_node* node) {
+    const uint64_t* word = find_node_bitset_word(bitset, node);
+    return word && (*word & (UINT64_C(1) << (node->id % 64))) != 0;
+}
+
+bool node_bitset_insert(struct node_bitset* bitset, const struct fir_node* node) {
+    size_t page_index = node->id / (NODE_BITSET_PAGE_SIZE * 64);
+    if (page_index >= bitset->page_count) {
+        size_t page_count = page_index + 1 > bitset->page_count * 2 ? page_index + 1 : bitset->page_count * 2;
+        bitset->pages = xrealloc(bitset->pages, sizeof(uint64_t*) * page_count);
+        memset(bitset->pages + bitset->page_count, 0, sizeof(uint64_t*) * (page_count - bitset->page_count));
+        bitset->page_count = page_count;
+    }
+    if (!bitset->pages[page_index])
+        bitset->pages[page_index] = xcalloc(NODE_BITSET_PAGE_SIZE, sizeof(uint64_t));
+    uint64_t* word = &bitset->pages[page_index][(node->id / 64) % NODE_BITSET_PAGE_SIZE];
+    uint64_t bit = UINT64_C(1) << (node->id % 64);
+    if (*word & bit)
+        return false;
+    *word |= bit;
+    return true;
+}
+
+bool node_bitset_remove(struct node_bitset* bitset, const struct fir_node* node) {
+    uint64_t* word = find_node_bitset_word(bitset, node);
+    uint64_t bit = UINT64_C(1) << (node->id % 64);
+    if (!word || !(*word & bit))
+        return false;
+    *word &= ~bit;
+    return true;
+}
@@ -21,3 +21,31 @@ SPAN_DECL(node_span, const struct fir_node*)
 CONST_SPAN_DECL(const_node_span, const struct fir_node*)
 MAP_DECL(use_map, const struct fir_use*, void*, PUBLIC)
 UNIQUE_STACK_DECL(unique_node_stack, const struct fir_node*, PUBLIC)
+
+// Map from nodes to non-null pointers, stored in arrays indexed by node ID. The arrays are
+// allocated in pages, on demand, which keeps the cost proportional to the range of IDs that are
+// actually used. This works best when the module IDs are dense (see `fir_mod_compact_ids`).
+struct node_array_map {
+    void*** pages;
+    size_t page_count;
+};
+
+[[nodiscard]] struct node_array_map node_array_map_create(void);
+void node_array_map_destroy(struct node_array_map*);
+void node_array_map_clear(struct node_array_map*);
+void* const* node_array_map_find(const struct node_array_map*, const struct fir_node*);
+bool node_array_map_insert(struct node_array_map*, const struct fir_node*, void* val);
+
+// Set of nodes represented by a bitset indexed by node ID, allocated in pages like
+// `node_array_map`.
+struct node_bitset {
+    uint64_t** pages;
+    size_t page_count;
+};
+
+[[nodiscard]] struct node_bitset node_bitset_create(void);
+void node_bitset_destroy(struct node_bitset*);
+void node_bitset_clear(struct node_bitset*);
+bool node_bitset_find(const struct node_bitset*, const struct fir_node*);
+bool node_bitset_insert(struct node_bitset*, const struct fir_node*);
+bool node_bitset_remove(struct node_bitset*, const struct fir_node*);
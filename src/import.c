@@ -0,0 +1,113 @@
+#include "import.h"
+
+#include "fir/module.h"
+#include "fir/node.h"
+
+#include <assert.h>
+
+struct node_importer node_importer_create(struct fir_mod* mod) {
+    return (struct node_importer) {
+        .mod = mod,
+        .imported_nodes = node_array_map_create(),
+        .stack = node_vec_create(),
+        .nominal_nodes = node_vec_create()
+    };
+}
+
+void node_importer_destroy(struct node_importer* importer) {
+    node_array_map_destroy(&importer->imported_nodes);
+    node_vec_destroy(&importer->stack);
+    node_vec_destroy(&importer->nominal_nodes);
+}
+
+void node_importer_map(struct node_importer* importer, const struct fir_node* from, const struct fir_node* to) {
+    [[maybe_unused]] bool was_inserted = node_array_map_insert(&importer->imported_nodes, from, (void*)to);
+    assert(was_inserted);
+}
+
+const struct fir_node* node_importer_find(const struct node_importer* importer, const struct fir_node* node) {
+    void* const* imported_node = node_array_map_find(&importer->imported_nodes, node);
+    return imported_node ? *imported_node : NULL;
+}
+
+static inline bool is_imported(struct node_importer* importer, const struct fir_node* node) {
+    if (!node || node_importer_find(importer, node))
+        return true;
+    node_vec_push(&importer->stack, &node);
+    return false;
+}
+
+static inline void import_nominal_node(struct node_importer* importer, const struct fir_node* node) {
+    const struct fir_node* ty = node_importer_find(importer, node->ty);
+    struct fir_node* imported_node = fir_node_clone(importer->mod, node, ty);
+    node_importer_map(importer, node, imported_node);
+    node_vec_push(&importer->nominal_nodes, &node);
+}
+
+static inline void import_structural_node(struct node_importer* importer, const struct fir_node* node) {
+    struct small_node_vec ops;
+    small_node_vec_init(&ops);
+    for (size_t i = 0; i < node->op_count; ++i)
+        small_node_vec_push(&ops, (const struct fir_node*[]) { node_importer_find(importer, node->ops[i]) });
+    const struct fir_node* imported_node = fir_node_rebuild(
+        importer->mod, node->tag, &node->data,
+        node->ctrl ? node_importer_find(importer, node->ctrl) : NULL,
+        fir_node_is_ty(node) ? NULL : node_importer_find(importer, node->ty),
+        ops.elems, node->op_count);
+    small_node_vec_destroy(&ops);
+    node_importer_map(importer, node, imported_node);
+}
+
+const struct fir_node* node_importer_import(struct node_importer* importer, const struct fir_node* node) {
+    const struct fir_node* imported_node = node_importer_find(importer, node);
+    if (imported_node)
+        return imported_node;
+
+    // Structural nodes are imported after their operands. Since cycles can only go through nominal
+    // nodes, which only need their type to be imported first, this always terminates.
+    assert(node_vec_is_empty(&importer->stack));
+    node_vec_push(&importer->stack, &node);
+    while (!node_vec_is_empty(&importer->stack)) {
+        const struct fir_node* top = *node_vec_last(&importer->stack);
+        if (node_importer_find(importer, top)) {
+            node_vec_pop(&importer->stack);
+            continue;
+        }
+
+        bool is_ready = true;
+        if (!fir_node_is_ty(top))
+            is_ready &= is_imported(importer, top->ty);
+        if (!fir_node_is_nominal(top)) {
+            is_ready &= is_imported(importer, top->ctrl);
+            for (size_t i = 0; i < top->op_count; ++i)
+                is_ready &= is_imported(importer, top->ops[i]);
+        }
+        if (!is_ready)
+            continue;
+
+        node_vec_pop(&importer->stack);
+        if (fir_node_is_nominal(top))
+            import_nominal_node(importer, top);
+        else
+            import_structural_node(importer, top);
+    }
+    return node_importer_find(importer, node);
+}
+
+void node_importer_finish(struct node_importer* importer) {
+    // Importing operands may clone other nominal nodes, which are appended to the list.
+    for (size_t i = 0; i < importer->nominal_nodes.elem_count; ++i) {
+        const struct fir_node* node = importer->nominal_nodes.elems[i];
+        struct fir_node* imported_node = (struct fir_node*)node_importer_find(importer, node);
+        fir_node_materialize((struct fir_node*)node);
+        for (size_t j = 0; j < node->op_count; ++j) {
+            if (node->ops[j])
+                fir_node_set_op(imported_node, j, node_importer_import(importer, node->ops[j]));
+        }
+        if (node->dbg_info)
+            fir_node_set_dbg_info(imported_node, node->dbg_info);
+        if (fir_node_is_external(node))
+            fir_node_make_external(imported_node);
+    }
+    node_vec_clear(&importer->nominal_nodes);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "datatypes.h"
+
+struct fir_mod;
+struct fir_node;
+
+// Imports nodes from a module into another. Structural nodes are rebuilt in the target module,
+// which deduplicates them against the nodes it already contains, and nominal nodes are cloned. The
+// operands of cloned nominal nodes are only imported by `node_importer_finish`, which makes it
+// possible to import recursive functions.
+struct node_importer {
+    struct fir_mod* mod;
+    struct node_array_map imported_nodes;
+    struct node_vec stack;
+    struct node_vec nominal_nodes;
+};
+
+[[nodiscard]] struct node_importer node_importer_create(struct fir_mod*);
+void node_importer_destroy(struct node_importer*);
+
+// Makes the importer map the given node onto another node of the target module.
+void node_importer_map(struct node_importer*, const struct fir_node* from, const struct fir_node* to);
+
+// Returns the node corresponding to the given node in the target module, or `NULL` if it has not
+// been imported yet.
+const struct fir_node* node_importer_find(const struct node_importer*, const struct fir_node*);
+
+const struct fir_node* node_importer_import(struct node_importer*, const struct fir_node*);
+
+// Imports the operands of the nominal nodes imported so far, and copies their debug information
+// and linkage.
+void node_importer_finish(struct node_importer*);
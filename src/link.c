@@ -0,0 +1,142 @@
+#include "fir/module.h"
+#include "fir/dbg_info.h"
+
+#include "import.h"
+
+#include <overture/map.h>
+#include <overture/vec.h>
+#include <overture/str.h>
+
+#include <inttypes.h>
+#include <stdarg.h>
+
+MAP_DEFINE(external_table, struct str_view, const struct fir_node*, str_view_hash, str_view_is_equal, PRIVATE)
+
+struct definition {
+    const struct fir_node* node;
+    struct fir_node* external_node;
+};
+
+VEC_DEFINE(definition_vec, struct definition, PRIVATE)
+
+static void report_conflict(FILE* error_log, const struct fir_node* node, const char* fmt, ...) {
+    if (!error_log)
+        return;
+    if (node->dbg_info && node->dbg_info->file_name) {
+        fprintf(error_log, "%s:%"PRIu32":%"PRIu32": ",
+            node->dbg_info->file_name,
+            node->dbg_info->source_range.begin.row,
+            node->dbg_info->source_range.begin.col);
+    }
+    fprintf(error_log, "error: ");
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(error_log, fmt, args);
+    va_end(args);
+    fprintf(error_log, "\n");
+}
+
+struct linker {
+    struct fir_mod* mod;
+    struct external_table external_table;
+    FILE* error_log;
+};
+
+static bool resolve_externals(
+    struct linker* linker,
+    struct node_importer* importer,
+    const struct fir_mod* src,
+    struct definition_vec* definitions)
+{
+    bool status = true;
+    for (const struct fir_node* node = fir_mod_first_external(src); node; node = fir_node_next_external(node)) {
+        struct str_view name = str_view_from(fir_node_name(node));
+        const struct fir_node* const* external_node = name.length > 0
+            ? external_table_find(&linker->external_table, &name) : NULL;
+        if (!external_node)
+            continue;
+
+        if (node->tag != (*external_node)->tag ||
+            node_importer_import(importer, node->ty) != (*external_node)->ty)
+        {
+            report_conflict(linker->error_log, node, "conflicting types for '%s'", name.data);
+            status = false;
+        } else if (fir_node_is_exported(node) && fir_node_is_exported(*external_node)) {
+            report_conflict(linker->error_log, node, "multiple definitions of '%s'", name.data);
+            status = false;
+        } else if (status) {
+            node_importer_map(importer, node, *external_node);
+            if (fir_node_is_exported(node)) {
+                fir_node_materialize((struct fir_node*)node);
+                definition_vec_push(definitions, &(struct definition) {
+                    .node = node,
+                    .external_node = (struct fir_node*)*external_node
+                });
+            }
+        }
+    }
+    return status;
+}
+
+static bool link_mod(struct linker* linker, const struct fir_mod* src) {
+    struct node_importer importer = node_importer_create(linker->mod);
+    struct definition_vec definitions = definition_vec_create();
+
+    bool status = resolve_externals(linker, &importer, src, &definitions);
+    if (status) {
+        struct fir_node* const* funcs = fir_mod_funcs(src);
+        struct fir_node* const* globals = fir_mod_globals(src);
+        for (size_t i = 0, n = fir_mod_func_count(src); i < n; ++i)
+            node_importer_import(&importer, funcs[i]);
+        for (size_t i = 0, n = fir_mod_global_count(src); i < n; ++i)
+            node_importer_import(&importer, globals[i]);
+
+        // Exported nodes that resolve to imported nodes of the destination module give them a
+        // definition.
+        VEC_FOREACH(const struct definition, definition, definitions) {
+            for (size_t i = 0; i < definition->node->op_count; ++i) {
+                if (definition->node->ops[i]) {
+                    fir_node_set_op(definition->external_node, i,
+                        node_importer_import(&importer, definition->node->ops[i]));
+                }
+            }
+        }
+        node_importer_finish(&importer);
+
+        // External nodes that were not resolved are now part of the destination module.
+        for (const struct fir_node* node = fir_mod_first_external(src); node; node = fir_node_next_external(node)) {
+            struct str_view name = str_view_from(fir_node_name(node));
+            const struct fir_node* imported_node = node_importer_find(&importer, node);
+            if (name.length > 0)
+                external_table_insert(&linker->external_table, &name, &imported_node);
+        }
+    }
+
+    definition_vec_destroy(&definitions);
+    node_importer_destroy(&importer);
+    return status;
+}
+
+bool fir_mod_link(struct fir_mod* dst, const struct fir_mod* src, FILE* error_log) {
+    return fir_mod_link_all(dst, &src, 1, error_log);
+}
+
+bool fir_mod_link_all(struct fir_mod* dst, const struct fir_mod* const* srcs, size_t src_count, FILE* error_log) {
+    struct linker linker = {
+        .mod = dst,
+        .external_table = external_table_create(),
+        .error_log = error_log
+    };
+    for (const struct fir_node* node = fir_mod_first_external(dst); node; node = fir_node_next_external(node)) {
+        struct str_view name = str_view_from(fir_node_name(node));
+        if (name.length > 0)
+            external_table_insert(&linker.external_table, &name, &node);
+    }
+
+    bool status = true;
+    for (size_t i = 0; i < src_count; ++i)
+        status &= link_mod(&linker, srcs[i]);
+
+    external_table_destroy(&linker.external_table);
+    return status;
+}
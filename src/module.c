@@ -2,18 +2,31 @@
 #include "fir/node.h"
 
 #include "datatypes.h"
+#include "binary.h"
 
 #include <overture/set.h>
 #include <overture/bits.h>
 #include <overture/vec.h>
 #include <overture/mem.h>
 #include <overture/hash.h>
+#include <overture/mem_pool.h>
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <math.h>
+#include <pthread.h>
 
 #define SMALL_NODE_OP_COUNT 8
 
+// Nodes are allocated by size class: Nodes with up to `SMALL_NODE_OP_COUNT` operands get one class
+// per operand count, and larger nodes are rounded up to the next power of two.
+#define NODE_SIZE_CLASS_COUNT (SMALL_NODE_OP_COUNT + 1 + 64)
+
+// Nodes that can be made external use a dedicated size class, because they carry a link in the list
+// of external nodes of the module.
+#define EXTERNAL_NODE_SIZE_CLASS NODE_SIZE_CLASS_COUNT
+
 struct small_node {
     FIR_NODE(SMALL_NODE_OP_COUNT)
 };
@@ -37,17 +50,17 @@ static uint32_t hash_node_data(uint32_t h, const struct fir_node* node) {
     return h;
 }
 
-static uint32_t hash_node(uint32_t h, const struct fir_node* const* node_ptr) {
-    const struct fir_node* node = *node_ptr;
+static uint32_t hash_node(const struct fir_node* node) {
+    uint32_t h = hash_init();
     h = hash_uint32(h, node->tag);
     if (!fir_node_is_ty(node))
-        h = hash_uint64(h, node->ty->id);
+        h = hash_uint32(h, node->ty->id);
     h = hash_node_data(h, node);
-    h = hash_uint64(h, node->op_count);
+    h = hash_uint32(h, node->op_count);
     if (node->ctrl)
-        h = hash_uint64(h, node->ctrl->id);
+        h = hash_uint32(h, node->ctrl->id);
     for (size_t i = 0; i < node->op_count; ++i)
-        h = hash_uint64(h, node->ops[i]->id);
+        h = hash_uint32(h, node->ops[i]->id);
     return h;
 }
 
@@ -67,12 +80,7 @@ static inline bool has_same_node_data(const struct fir_node* node, const struct
     return true;
 }
 
-static inline bool is_node_equal(
-    const struct fir_node* const* node_ptr,
-    const struct fir_node* const* other_ptr)
-{
-    const struct fir_node* node  = *node_ptr;
-    const struct fir_node* other = *other_ptr;
+static inline bool is_node_equal(const struct fir_node* node, const struct fir_node* other) {
     if (node->tag != other->tag || node->op_count != other->op_count)
         return false;
     if (!fir_node_is_ty(node) && node->ty != other->ty)
@@ -88,17 +96,161 @@ static inline bool is_node_equal(
     return true;
 }
 
-SET_DEFINE(internal_node_set, const struct fir_node*, hash_node, is_node_equal, PRIVATE)
+// Hash-consing table, using open addressing with linear probing. Structural nodes cache their hash,
+// which makes growing the table a matter of moving pointers around, and allows rejecting most
+// collisions without comparing operands.
+struct node_table {
+    const struct fir_node** nodes;
+    size_t capacity;
+    size_t node_count;
+    struct fir_hash_cons_stats stats;
+};
+
+#define NODE_TABLE_MIN_CAPACITY 64
+
+#define NODE_TABLE_FOREACH(node, table) \
+    for (size_t node##_index = 0; node##_index < (table).capacity; ++node##_index) \
+        for (const struct fir_node* node = (table).nodes[node##_index]; node; node = NULL)
+
+static struct node_table node_table_create(void) {
+    return (struct node_table) {
+        .nodes = xcalloc(NODE_TABLE_MIN_CAPACITY, sizeof(const struct fir_node*)),
+        .capacity = NODE_TABLE_MIN_CAPACITY
+    };
+}
+
+static void node_table_destroy(struct node_table* table) {
+    free(table->nodes);
+}
+
+static const struct fir_node* node_table_find(
+    struct node_table* table,
+    const struct fir_node* node,
+    uint32_t hash)
+{
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        table->stats.probe_count++;
+        const struct fir_node* other = table->nodes[i];
+        if (!other) {
+            table->stats.miss_count++;
+            return NULL;
+        }
+        if (other->hash == hash && is_node_equal(node, other)) {
+            table->stats.hit_count++;
+            return other;
+        }
+    }
+}
+
+static void node_table_place(const struct fir_node** nodes, size_t capacity, const struct fir_node* node) {
+    size_t mask = capacity - 1;
+    size_t i = node->hash & mask;
+    while (nodes[i])
+        i = (i + 1) & mask;
+    nodes[i] = node;
+}
+
+static void node_table_grow(struct node_table* table) {
+    size_t capacity = table->capacity * 2;
+    const struct fir_node** nodes = xcalloc(capacity, sizeof(const struct fir_node*));
+    NODE_TABLE_FOREACH(node, *table) {
+        node_table_place(nodes, capacity, node);
+    }
+    free(table->nodes);
+    table->nodes = nodes;
+    table->capacity = capacity;
+}
+
+static void node_table_insert(struct node_table* table, const struct fir_node* node) {
+    if ((table->node_count + 1) * 4 > table->capacity * 3)
+        node_table_grow(table);
+    node_table_place(table->nodes, table->capacity, node);
+    table->node_count++;
+}
+
+static void node_table_remove(struct node_table* table, const struct fir_node* node) {
+    size_t mask = table->capacity - 1;
+    size_t i = node->hash & mask;
+    while (table->nodes[i] != node) {
+        assert(table->nodes[i] && "trying to remove non-existing node");
+        i = (i + 1) & mask;
+    }
+
+    // Shift back the following nodes of the cluster that would otherwise become unreachable.
+    for (size_t j = (i + 1) & mask; table->nodes[j]; j = (j + 1) & mask) {
+        size_t k = table->nodes[j]->hash & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        table->nodes[i] = table->nodes[j];
+        i = j;
+    }
+    table->nodes[i] = NULL;
+    table->node_count--;
+}
+
 VEC_DEFINE(nominal_node_vec, struct fir_node*, PRIVATE)
 
+struct node_allocator {
+    struct mem_pool pool;
+    size_t pool_bytes;
+    struct fir_node* free_nodes[NODE_SIZE_CLASS_COUNT + 1];
+};
+
+// Structural nodes are distributed over shards according to their hash. Each shard owns the nodes
+// that it contains, and has its own lock, so that threads building unrelated nodes in a concurrent
+// module rarely wait for each other. Modules that are not concurrent use a single shard.
+struct node_shard {
+    struct node_table nodes;
+    struct node_allocator allocator;
+    struct node_vec dirty_nodes;
+    pthread_mutex_t mutex;
+};
+
+// Changes made to a module while a checkpoint is active are recorded, so that they can be undone in
+// reverse order when rolling back.
+enum change_tag {
+    CHANGE_NEW_NODE,
+    CHANGE_SET_OP,
+    CHANGE_MAKE_EXTERNAL,
+    CHANGE_MAKE_INTERNAL
+};
+
+struct change {
+    enum change_tag tag;
+    struct fir_node* node;
+    size_t op_index;
+    const struct fir_node* op; // Previous operand, or previous external node.
+};
+
+struct checkpoint {
+    size_t change_count;
+    size_t dirty_node_count;
+    size_t shard_dirty_node_count;
+    uint32_t first_id;
+};
+
+VEC_DEFINE(change_vec, struct change, PRIVATE)
+VEC_DEFINE(checkpoint_vec, struct checkpoint, PRIVATE)
+VEC_DEFINE(observer_vec, struct fir_mod_observer*, PRIVATE)
+
+#define CONCURRENT_SHARD_BITS 6
+#define USE_MUTEX_COUNT 256
+
+#define SHARD_FOREACH(shard, mod) \
+    for (struct node_shard* shard = (mod)->shards; shard != (mod)->shards + (mod)->shard_count; ++shard)
+
 struct fir_mod {
     char* name;
-    uint64_t cur_id;
+    _Atomic(uint32_t) cur_id;
+    bool is_concurrent;
     struct nominal_node_vec funcs;
     struct nominal_node_vec globals;
     struct nominal_node_vec locals;
-    struct internal_node_set nodes;
-    struct node_set external_nodes;
+    struct node_shard* shards;
+    size_t shard_count;
+    struct fir_node* first_external;
+    struct fir_node* last_external;
     const struct fir_node* mem_ty;
     const struct fir_node* frame_ty;
     const struct fir_node* ctrl_ty;
@@ -108,65 +260,263 @@ struct fir_mod {
     const struct fir_node* unit;
     const struct fir_node* bool_ty;
     const struct fir_node* index_ty;
-    struct fir_use* free_uses;
+    struct node_allocator nominal_allocator;
+    struct node_vec dirty_nodes;
+    struct fir_reclaim_stats reclaim_stats;
+    struct change_vec changes;
+    struct checkpoint_vec checkpoints;
+    struct binary_loader* binary_loader;
+    size_t materialized_func_count;
+    struct observer_vec observers;
+
+    // This protects nominal nodes, the list of external nodes, and the dirty nodes of the module.
+    pthread_mutex_t mutex;
+    // The use list of each node is protected by one of these, chosen according to the node ID.
+    pthread_mutex_t use_mutexes[USE_MUTEX_COUNT];
+};
+
+static inline size_t node_size_class(size_t op_count) {
+    if (op_count <= SMALL_NODE_OP_COUNT)
+        return op_count;
+    size_t size_class = SMALL_NODE_OP_COUNT + 1;
+    for (size_t capacity = SMALL_NODE_OP_COUNT * 2; capacity < op_count; capacity *= 2)
+        size_class++;
+    assert(size_class < NODE_SIZE_CLASS_COUNT);
+    return size_class;
+}
+
+static inline size_t node_size_class_capacity(size_t size_class) {
+    if (size_class == EXTERNAL_NODE_SIZE_CLASS)
+        return 1;
+    return size_class <= SMALL_NODE_OP_COUNT
+        ? size_class : (size_t)SMALL_NODE_OP_COUNT << (size_class - SMALL_NODE_OP_COUNT);
+}
+
+// The use of each operand is stored inline, right after the operand array of the user, so that
+// recording or forgetting a use never allocates. Each use also remembers the link that points to
+// it, so that it can be removed from the use list of the operand in constant time.
+struct op_use {
+    struct fir_use use;
+    const struct fir_use** prev;
+};
+
+struct external_link {
+    struct fir_node* prev;
+    struct fir_node* next;
 };
 
-static struct fir_use* alloc_use(struct fir_mod* mod, const struct fir_use* use) {
-    struct fir_use* alloced_use = mod->free_uses;
-    if (alloced_use)
-        mod->free_uses = (struct fir_use*)mod->free_uses->next;
+static inline size_t node_size_class_size(size_t size_class) {
+    size_t size = sizeof(struct fir_node) +
+        (sizeof(struct fir_node*) + sizeof(struct op_use)) * node_size_class_capacity(size_class);
+    return size_class == EXTERNAL_NODE_SIZE_CLASS ? size + sizeof(struct external_link) : size;
+}
+
+static inline size_t node_alloc_class(const struct fir_node* node) {
+    return fir_node_can_be_external(node) ? EXTERNAL_NODE_SIZE_CLASS : node_size_class(node->op_count);
+}
+
+static inline struct op_use* node_op_uses(const struct fir_node* node) {
+    return (struct op_use*)(node->ops + node->op_count);
+}
+
+static inline struct op_use* to_op_use(const struct fir_use* use) {
+    return (struct op_use*)use;
+}
+
+static inline struct external_link* node_external_link(const struct fir_node* node) {
+    assert(fir_node_can_be_external(node));
+    return (struct external_link*)(node_op_uses(node) + node->op_count);
+}
+
+static inline void lock_mutex(const struct fir_mod* mod, pthread_mutex_t* mutex) {
+    if (mod->is_concurrent)
+        pthread_mutex_lock(mutex);
+}
+
+static inline void unlock_mutex(const struct fir_mod* mod, pthread_mutex_t* mutex) {
+    if (mod->is_concurrent)
+        pthread_mutex_unlock(mutex);
+}
+
+static inline uint32_t next_id(struct fir_mod* mod) {
+    uint32_t id;
+    if (mod->is_concurrent) {
+        id = atomic_fetch_add_explicit(&mod->cur_id, 1, memory_order_relaxed);
+    } else {
+        id = atomic_load_explicit(&mod->cur_id, memory_order_relaxed);
+        atomic_store_explicit(&mod->cur_id, id + 1, memory_order_relaxed);
+    }
+    // Identifiers index tables in the analyses and are assumed to be unique, so running out of them
+    // cannot be recovered from, even in release builds.
+    if (id == UINT32_MAX) {
+        fprintf(stderr, "too many nodes in module '%s', consider compacting identifiers\n", mod->name);
+        abort();
+    }
+    return id;
+}
+
+static inline struct node_shard* find_shard(const struct fir_mod* mod, uint32_t hash) {
+    // The table of each shard uses the lower bits of the hash, so shards are selected with the
+    // upper bits.
+    return &mod->shards[mod->shard_count > 1 ? hash >> (32 - CONCURRENT_SHARD_BITS) : 0];
+}
+
+static inline pthread_mutex_t* find_use_mutex(struct fir_mod* mod, const struct fir_node* node) {
+    return &mod->use_mutexes[node->id % USE_MUTEX_COUNT];
+}
+
+static struct node_allocator node_allocator_create(void) {
+    return (struct node_allocator) { .pool = mem_pool_create() };
+}
+
+static void node_allocator_destroy(struct node_allocator* allocator) {
+    mem_pool_destroy(&allocator->pool);
+}
+
+static struct fir_node* alloc_node_in_class(struct node_allocator* allocator, size_t size_class) {
+    size_t size = node_size_class_size(size_class);
+    struct fir_node* node = allocator->free_nodes[size_class];
+    if (node) {
+        allocator->free_nodes[size_class] = (struct fir_node*)node->uses;
+    } else {
+        node = mem_pool_alloc(&allocator->pool, size, alignof(struct fir_node));
+        allocator->pool_bytes += size;
+    }
+    memset(node, 0, size);
+    return node;
+}
+
+static struct fir_node* alloc_node(struct node_allocator* allocator, size_t op_count) {
+    return alloc_node_in_class(allocator, node_size_class(op_count));
+}
+
+// Large nodes that are only needed to look up the hash-consing table are allocated separately.
+static struct fir_node* alloc_temp_node(size_t op_count) {
+    return xcalloc(1, sizeof(struct fir_node) + sizeof(struct fir_node*) * op_count);
+}
+
+static void link_external_node(struct fir_mod* mod, struct fir_node* node, struct fir_node* prev) {
+    struct external_link* link = node_external_link(node);
+    link->prev = prev;
+    link->next = prev ? node_external_link(prev)->next : mod->first_external;
+    if (link->next)
+        node_external_link(link->next)->prev = node;
     else
-        alloced_use = xmalloc(sizeof(struct fir_use));
-    memcpy(alloced_use, use, sizeof(struct fir_use));
-    return alloced_use;
+        mod->last_external = node;
+    if (prev)
+        node_external_link(prev)->next = node;
+    else
+        mod->first_external = node;
 }
 
-static void record_use(const struct fir_node* user, size_t i) {
-    assert(user->op_count > i);
-    struct fir_mod* mod = fir_node_mod(user);
-    struct fir_node* used = (struct fir_node*)user->ops[i];
-    assert(!fir_node_is_ty(used));
-    assert(!fir_node_is_ty(user));
-    used->uses = alloc_use(mod, &(struct fir_use) {
-        .user = user,
-        .index = i,
-        .next = used->uses
-    });
+static void unlink_external_node(struct fir_mod* mod, struct fir_node* node) {
+    struct external_link* link = node_external_link(node);
+    if (link->prev)
+        node_external_link(link->prev)->next = link->next;
+    else
+        mod->first_external = link->next;
+    if (link->next)
+        node_external_link(link->next)->prev = link->prev;
+    else
+        mod->last_external = link->prev;
+    link->prev = link->next = NULL;
+}
+
+static void record_reclaimed_node(struct fir_reclaim_stats* stats, const struct fir_node* node, size_t size) {
+    stats->node_count++;
+    stats->node_bytes += size;
+    if (fir_node_is_ty(node)) {
+        stats->type_count++;
+        stats->type_bytes += size;
+    } else if (node->tag == FIR_CONST) {
+        stats->const_count++;
+        stats->const_bytes += size;
+    }
 }
 
-static void forget_use(const struct fir_node* user, size_t i) {
+static void free_node(struct fir_mod* mod, struct fir_node* node) {
+    if (fir_node_is_external(node))
+        unlink_external_node(mod, node);
+
+    // Free nodes are chained through their use list, which is dead at this point.
+    struct node_allocator* allocator = fir_node_is_nominal(node)
+        ? &mod->nominal_allocator : &find_shard(mod, node->hash)->allocator;
+    size_t size_class = node_alloc_class(node);
+    node->uses = (const struct fir_use*)allocator->free_nodes[size_class];
+    allocator->free_nodes[size_class] = node;
+}
+
+static void reclaim_node(struct fir_mod* mod, struct fir_node* node) {
+    // Rolling back a checkpoint also frees nodes, but only those freed by a cleanup are recorded.
+    record_reclaimed_node(&mod->reclaim_stats, node, node_size_class_size(node_alloc_class(node)));
+    free_node(mod, node);
+}
+
+static void record_use(struct fir_mod* mod, const struct fir_node* user, size_t i) {
     assert(user->op_count > i);
-    struct fir_mod* mod = fir_node_mod(user);
     struct fir_node* used = (struct fir_node*)user->ops[i];
     assert(!fir_node_is_ty(used));
     assert(!fir_node_is_ty(user));
-    const struct fir_use** prev = (const struct fir_use**)&used->uses;
-    for (struct fir_use* use = (struct fir_use*)used->uses; use; prev = &use->next, use = (struct fir_use*)use->next) {
-        if (use->user == user && use->index == i) {
-            *prev = use->next;
-            use->next = mod->free_uses;
-            mod->free_uses = use;
-            return;
-        }
-    }
-    assert(false && "trying to remove non-existing use");
+    pthread_mutex_t* mutex = find_use_mutex(mod, used);
+    lock_mutex(mod, mutex);
+    struct op_use* op_use = &node_op_uses(user)[i];
+    op_use->use.user = user;
+    op_use->use.index = i;
+    op_use->use.next = used->uses;
+    op_use->prev = &used->uses;
+    if (used->uses)
+        to_op_use(used->uses)->prev = &op_use->use.next;
+    used->uses = &op_use->use;
+    unlock_mutex(mod, mutex);
+}
+
+static void unlink_use(struct op_use* op_use) {
+    assert(*op_use->prev == &op_use->use && "trying to remove non-existing use");
+    *op_use->prev = op_use->use.next;
+    if (op_use->use.next)
+        to_op_use(op_use->use.next)->prev = op_use->prev;
+}
+
+static void forget_use(struct fir_mod* mod, const struct fir_node* user, size_t i) {
+    assert(user->op_count > i);
+    assert(!fir_node_is_ty(user->ops[i]));
+    assert(!fir_node_is_ty(user));
+    pthread_mutex_t* mutex = find_use_mutex(mod, user->ops[i]);
+    lock_mutex(mod, mutex);
+    unlink_use(&node_op_uses(user)[i]);
+    unlock_mutex(mod, mutex);
 }
 
-static void free_uses(struct fir_use* uses) {
-    while (uses) {
-        struct fir_use* next = (struct fir_use*)uses->next;
-        free(uses);
-        uses = next;
-    }
+// Nodes that are created or that lose a use are recorded as dirty, since they are the only ones
+// that may have become dead since the last collection. New structural nodes are recorded in their
+// shard instead, while its lock is held. Nodes are only recorded the first time they become dirty,
+// which bounds the size of the lists by the number of nodes, and avoids taking the lock for nodes
+// that are dirty already.
+static inline void set_dirty(struct fir_node* node) {
+    atomic_store_explicit(&node->is_dirty, true, memory_order_relaxed);
 }
 
-static struct fir_node* alloc_node(size_t op_count) {
-    return xcalloc(1, sizeof(struct fir_node) + sizeof(struct fir_node*) * op_count);
+static inline bool test_and_set_dirty(struct fir_mod* mod, const struct fir_node* node) {
+    struct fir_node* dirty_node = (struct fir_node*)node;
+    if (atomic_load_explicit(&dirty_node->is_dirty, memory_order_relaxed))
+        return true;
+    if (mod->is_concurrent)
+        return atomic_exchange_explicit(&dirty_node->is_dirty, true, memory_order_relaxed);
+    set_dirty(dirty_node);
+    return false;
 }
 
-static void free_node(struct fir_node* node) {
-    free_uses((struct fir_use*)node->uses);
-    free(node);
+static inline void mark_dirty(struct fir_mod* mod, const struct fir_node* node) {
+    if (fir_node_is_ty(node) || test_and_set_dirty(mod, node))
+        return;
+    lock_mutex(mod, &mod->mutex);
+    node_vec_push(&mod->dirty_nodes, &node);
+    unlock_mutex(mod, &mod->mutex);
+}
+
+static inline void record_change(struct fir_mod* mod, const struct change* change) {
+    if (!checkpoint_vec_is_empty(&mod->checkpoints))
+        change_vec_push(&mod->changes, change);
 }
 
 static inline bool has_side_effect(const struct fir_node* node) {
@@ -224,31 +574,58 @@ static inline const struct fir_node* insert_node(struct fir_mod* mod, const stru
         assert(fir_node_mod(node->ops[i]) == mod);
 #endif
 
-    const struct fir_node* const* found = internal_node_set_find(&mod->nodes, &node);
-    if (found)
-        return *found;
-    struct fir_node* new_node = alloc_node(node->op_count);
+    uint32_t hash = hash_node(node);
+    struct node_shard* shard = find_shard(mod, hash);
+    lock_mutex(mod, &shard->mutex);
+    const struct fir_node* found = node_table_find(&shard->nodes, node, hash);
+    if (found) {
+        unlock_mutex(mod, &shard->mutex);
+        return found;
+    }
+    struct fir_node* new_node = alloc_node(&shard->allocator, node->op_count);
     memcpy(new_node, node, sizeof(struct fir_node) + sizeof(struct fir_node*) * node->op_count);
+    new_node->hash = hash;
     if (!fir_node_is_ty(node)) {
         for (size_t i = 0; i < node->op_count; ++i) {
             if (!fir_node_is_ty(node->ops[i]))
-                record_use(new_node, i);
+                record_use(mod, new_node, i);
         }
     }
     new_node->props = compute_props(new_node);
-    new_node->id = mod->cur_id++;
+    new_node->id = next_id(mod);
 
-    [[maybe_unused]] bool was_inserted = internal_node_set_insert(&mod->nodes, (const struct fir_node* const*)&new_node);
-    assert(was_inserted);
+    node_table_insert(&shard->nodes, new_node);
+    if (!fir_node_is_ty(new_node)) {
+        set_dirty(new_node);
+        node_vec_push(&shard->dirty_nodes, (const struct fir_node**)&new_node);
+    }
+    record_change(mod, &(struct change) { .tag = CHANGE_NEW_NODE, .node = new_node });
+    unlock_mutex(mod, &shard->mutex);
     return new_node;
 }
 
-struct fir_mod* fir_mod_create(const char* name) {
+static struct fir_mod* create_mod(const char* name, bool is_concurrent) {
     struct fir_mod* mod = xcalloc(1, sizeof(struct fir_mod));
     mod->name = strdup(name);
     mod->cur_id = 0;
-    mod->nodes   = internal_node_set_create();
-    mod->external_nodes = node_set_create();
+    mod->is_concurrent = is_concurrent;
+    mod->shard_count = is_concurrent ? (size_t)1 << CONCURRENT_SHARD_BITS : 1;
+    mod->shards = xcalloc(mod->shard_count, sizeof(struct node_shard));
+    SHARD_FOREACH(shard, mod) {
+        shard->nodes = node_table_create();
+        shard->allocator = node_allocator_create();
+        shard->dirty_nodes = node_vec_create();
+        pthread_mutex_init(&shard->mutex, NULL);
+    }
+    mod->nominal_allocator = node_allocator_create();
+    mod->dirty_nodes = node_vec_create();
+    mod->changes = change_vec_create();
+    mod->checkpoints = checkpoint_vec_create();
+    mod->observers = observer_vec_create();
+    pthread_mutex_init(&mod->mutex, NULL);
+    for (size_t i = 0; i < USE_MUTEX_COUNT; ++i)
+        pthread_mutex_init(&mod->use_mutexes[i], NULL);
+
     mod->mem_ty   = insert_node(mod, &(struct fir_node) { .tag = FIR_MEM_TY,   .mod = mod });
     mod->frame_ty = insert_node(mod, &(struct fir_node) { .tag = FIR_FRAME_TY, .mod = mod });
     mod->ctrl_ty  = insert_node(mod, &(struct fir_node) { .tag = FIR_CTRL_TY,  .mod = mod });
@@ -261,29 +638,43 @@ struct fir_mod* fir_mod_create(const char* name) {
     return mod;
 }
 
+struct fir_mod* fir_mod_create(const char* name) {
+    return create_mod(name, false);
+}
+
+struct fir_mod* fir_mod_create_concurrent(const char* name) {
+    return create_mod(name, true);
+}
+
 void fir_mod_destroy(struct fir_mod* mod) {
     free(mod->name);
-    SET_FOREACH(struct fir_node*, node_ptr, mod->nodes) {
-        free_node((struct fir_node*)*node_ptr);
-    }
-    VEC_FOREACH(struct fir_node*, func_ptr, mod->funcs) {
-        free_node((struct fir_node*)*func_ptr);
-    }
-    VEC_FOREACH(struct fir_node*, global_ptr, mod->globals) {
-        free_node((struct fir_node*)*global_ptr);
+    SHARD_FOREACH(shard, mod) {
+        node_table_destroy(&shard->nodes);
+        node_allocator_destroy(&shard->allocator);
+        node_vec_destroy(&shard->dirty_nodes);
+        pthread_mutex_destroy(&shard->mutex);
     }
-    VEC_FOREACH(struct fir_node*, local_ptr, mod->locals) {
-        free_node((struct fir_node*)*local_ptr);
-    }
-    node_set_destroy(&mod->external_nodes);
-    internal_node_set_destroy(&mod->nodes);
+    free(mod->shards);
+    node_allocator_destroy(&mod->nominal_allocator);
     nominal_node_vec_destroy(&mod->funcs);
     nominal_node_vec_destroy(&mod->globals);
     nominal_node_vec_destroy(&mod->locals);
-    free_uses(mod->free_uses);
+    node_vec_destroy(&mod->dirty_nodes);
+    change_vec_destroy(&mod->changes);
+    checkpoint_vec_destroy(&mod->checkpoints);
+    observer_vec_destroy(&mod->observers);
+    if (mod->binary_loader)
+        binary_loader_destroy(mod->binary_loader);
+    pthread_mutex_destroy(&mod->mutex);
+    for (size_t i = 0; i < USE_MUTEX_COUNT; ++i)
+        pthread_mutex_destroy(&mod->use_mutexes[i]);
     free(mod);
 }
 
+bool fir_mod_is_concurrent(const struct fir_mod* mod) {
+    return mod->is_concurrent;
+}
+
 const char* fir_mod_name(const struct fir_mod* mod) {
     return mod->name;
 }
@@ -301,7 +692,8 @@ void fir_mod_set_name_with_length(struct fir_mod* mod, const char* name, size_t
 static void visit_live_node(
     const struct fir_node* node,
     struct node_vec* stack,
-    struct node_set* visited_nodes)
+    struct node_set* visited_nodes,
+    bool visit_types)
 {
     node_vec_push(stack, &node);
     while (stack->elem_count > 0) {
@@ -309,6 +701,8 @@ static void visit_live_node(
         if (!node_set_insert(visited_nodes, &top))
             continue;
 
+        if (visit_types && !fir_node_is_ty(top))
+            node_vec_push(stack, &top->ty);
         if (top->ctrl)
             node_vec_push(stack, &top->ctrl);
         for (size_t i = 0; i < top->op_count; ++i) {
@@ -318,37 +712,52 @@ static void visit_live_node(
     }
 }
 
-static struct node_set collect_live_nodes(struct fir_mod* mod) {
+static struct node_set collect_live_nodes(struct fir_mod* mod, bool visit_types) {
     struct node_set live_nodes = node_set_create();
     struct node_vec stack = node_vec_create();
     VEC_FOREACH(struct fir_node*, func_ptr, mod->funcs) {
         if (fir_node_is_exported(*func_ptr))
-            visit_live_node(*func_ptr, &stack, &live_nodes);
+            visit_live_node(*func_ptr, &stack, &live_nodes, visit_types);
     }
     VEC_FOREACH(struct fir_node*, global_ptr, mod->globals) {
         if (fir_node_is_exported(*global_ptr))
-            visit_live_node(*global_ptr, &stack, &live_nodes);
+            visit_live_node(*global_ptr, &stack, &live_nodes, visit_types);
+    }
+
+    // The bodies of lazy functions may refer to any nominal node, or to any type read along with
+    // them, which must then stay alive until they are materialized.
+    if (mod->binary_loader) {
+        VEC_FOREACH(struct fir_node*, func_ptr, mod->funcs)
+            visit_live_node(*func_ptr, &stack, &live_nodes, visit_types);
+        VEC_FOREACH(struct fir_node*, global_ptr, mod->globals)
+            visit_live_node(*global_ptr, &stack, &live_nodes, visit_types);
+        VEC_FOREACH(struct fir_node*, local_ptr, mod->locals)
+            visit_live_node(*local_ptr, &stack, &live_nodes, visit_types);
+        size_t type_count = 0;
+        const struct fir_node* const* types = binary_loader_types(mod->binary_loader, &type_count);
+        for (size_t i = 0; i < type_count && visit_types; ++i)
+            visit_live_node(types[i], &stack, &live_nodes, visit_types);
+    }
+
+    // The nodes cached in the module must stay alive, since they are returned without going through
+    // hash-consing.
+    visit_live_node(mod->unit, &stack, &live_nodes, visit_types);
+    if (visit_types) {
+        const struct fir_node* cached_tys[] = {
+            mod->mem_ty, mod->frame_ty, mod->ctrl_ty, mod->noret_ty,
+            mod->ptr_ty, mod->unit_ty, mod->bool_ty, mod->index_ty
+        };
+        for (size_t i = 0; i < sizeof(cached_tys) / sizeof(cached_tys[0]); ++i)
+            visit_live_node(cached_tys[i], &stack, &live_nodes, visit_types);
     }
     node_vec_destroy(&stack);
     return live_nodes;
 }
 
 static void fix_uses(const struct fir_node* node, const struct node_set* live_nodes) {
-    struct fir_mod* mod = fir_node_mod(node);
-    struct fir_use* use = (struct fir_use*)node->uses;
-    const struct fir_use** prev = &((struct fir_node*)node)->uses;
-    while (true) {
-        while (use && !node_set_find(live_nodes, &use->user)) {
-            struct fir_use* next = (struct fir_use*)use->next;
-            use->next = mod->free_uses;
-            mod->free_uses = use;
-            use = next;
-        }
-        *prev = use;
-        if (!use)
-            break;
-        prev = &use->next;
-        use = (struct fir_use*)use->next;
+    for (const struct fir_use* use = node->uses; use; use = use->next) {
+        if (!node_set_find(live_nodes, &use->user))
+            unlink_use(to_op_use(use));
     }
 }
 
@@ -364,6 +773,7 @@ static void fix_nominal_nodes_uses(
 }
 
 static inline void cleanup_nominal_nodes(
+    struct fir_mod* mod,
     struct nominal_node_vec* nodes,
     const struct node_set* live_nodes)
 {
@@ -372,17 +782,36 @@ static inline void cleanup_nominal_nodes(
         if (node_set_find(live_nodes, (const struct fir_node*const*)&nodes->elems[i]))
             nodes->elems[node_count++] = nodes->elems[i];
         else
-            free_node(nodes->elems[i]);
+            reclaim_node(mod, nodes->elems[i]);
     }
     nominal_node_vec_resize(nodes, node_count);
 }
 
-void fir_mod_cleanup(struct fir_mod* mod) {
-    struct node_set live_nodes = collect_live_nodes(mod);
-    SET_FOREACH(const struct fir_node*, node_ptr, mod->nodes) {
-        if (fir_node_is_ty(*node_ptr) || !node_set_find(&live_nodes, node_ptr))
+static void notify_reset(struct fir_mod* mod) {
+    VEC_FOREACH(struct fir_mod_observer*, observer_ptr, mod->observers)
+        (*observer_ptr)->reset(*observer_ptr);
+}
+
+// This must be called before dead nodes are reclaimed, since the nodes of the lists are modified.
+static void clear_dirty_nodes(struct fir_mod* mod) {
+    VEC_FOREACH(const struct fir_node*, node_ptr, mod->dirty_nodes)
+        atomic_store_explicit(&((struct fir_node*)*node_ptr)->is_dirty, false, memory_order_relaxed);
+    node_vec_clear(&mod->dirty_nodes);
+    SHARD_FOREACH(shard, mod) {
+        VEC_FOREACH(const struct fir_node*, node_ptr, shard->dirty_nodes)
+            atomic_store_explicit(&((struct fir_node*)*node_ptr)->is_dirty, false, memory_order_relaxed);
+        node_vec_clear(&shard->dirty_nodes);
+    }
+}
+
+static void cleanup(struct fir_mod* mod, bool reclaim_types) {
+    assert(checkpoint_vec_is_empty(&mod->checkpoints));
+    clear_dirty_nodes(mod);
+    struct node_set live_nodes = collect_live_nodes(mod, reclaim_types);
+    SHARD_FOREACH(shard, mod) NODE_TABLE_FOREACH(node, shard->nodes) {
+        if (fir_node_is_ty(node) || !node_set_find(&live_nodes, &node))
             continue;
-        fix_uses(*node_ptr, &live_nodes);
+        fix_uses(node, &live_nodes);
     }
 
     fix_nominal_nodes_uses(&mod->funcs, &live_nodes);
@@ -390,50 +819,422 @@ void fir_mod_cleanup(struct fir_mod* mod) {
     fix_nominal_nodes_uses(&mod->locals, &live_nodes);
 
     struct node_vec dead_nodes = node_vec_create();
-    SET_FOREACH(const struct fir_node*, node_ptr, mod->nodes) {
-        if (!fir_node_is_ty(*node_ptr) && !node_set_find(&live_nodes, node_ptr))
-            node_vec_push(&dead_nodes, node_ptr);
+    SHARD_FOREACH(shard, mod) NODE_TABLE_FOREACH(node, shard->nodes) {
+        if ((reclaim_types || !fir_node_is_ty(node)) && !node_set_find(&live_nodes, &node))
+            node_vec_push(&dead_nodes, &node);
     }
 
     VEC_FOREACH(const struct fir_node*, node_ptr, dead_nodes) {
-        [[maybe_unused]] bool was_removed = internal_node_set_remove(&mod->nodes, node_ptr);
-        assert(was_removed);
+        node_table_remove(&find_shard(mod, (*node_ptr)->hash)->nodes, *node_ptr);
     }
 
     VEC_FOREACH(const struct fir_node*, node_ptr, dead_nodes) {
-        free_node((struct fir_node*)*node_ptr);
+        reclaim_node(mod, (struct fir_node*)*node_ptr);
     }
 
-    cleanup_nominal_nodes(&mod->funcs, &live_nodes);
-    cleanup_nominal_nodes(&mod->globals, &live_nodes);
-    cleanup_nominal_nodes(&mod->locals, &live_nodes);
+    cleanup_nominal_nodes(mod, &mod->funcs, &live_nodes);
+    cleanup_nominal_nodes(mod, &mod->globals, &live_nodes);
+    cleanup_nominal_nodes(mod, &mod->locals, &live_nodes);
 
     node_vec_destroy(&dead_nodes);
     node_set_destroy(&live_nodes);
+    notify_reset(mod);
 }
 
-void fir_node_set_op(struct fir_node* node, size_t op_index, const struct fir_node* op) {
-    assert(op_index < node->op_count);
-    if (node->ops[op_index])
-        forget_use(node, op_index);
+void fir_mod_cleanup(struct fir_mod* mod) {
+    cleanup(mod, false);
+}
+
+void fir_mod_cleanup_types(struct fir_mod* mod) {
+    cleanup(mod, true);
+}
+
+struct use_cursor {
+    const struct fir_node* node;
+    const struct fir_use* use;
+};
+
+VEC_DEFINE(use_cursor_vec, struct use_cursor, PRIVATE)
+
+struct incremental_cleanup {
+    struct node_bitset live_nodes;
+    struct node_bitset dead_nodes;
+    struct node_bitset visited_nodes;
+    struct node_vec dead_node_list;
+    struct node_vec visit_list;
+    struct use_cursor_vec stack;
+};
+
+static inline bool is_cleanup_root(const struct fir_node* node) {
+    // Control nodes are referenced by the `ctrl` field of other nodes, which is not recorded in the
+    // use lists. They are conservatively kept alive until the next full collection.
+    return
+        fir_node_is_exported(node) ||
+        node->tag == FIR_CTRL ||
+        node == fir_node_mod(node)->unit ||
+        (fir_node_is_nominal(node) && fir_node_mod(node)->binary_loader);
+}
+
+static void visit_cleanup_node(struct incremental_cleanup* cleanup, const struct fir_node* node) {
+    node_bitset_insert(&cleanup->visited_nodes, node);
+    node_vec_push(&cleanup->visit_list, &node);
+    use_cursor_vec_push(&cleanup->stack, &(struct use_cursor) { .node = node, .use = node->uses });
+}
+
+static bool has_path_to_root(struct incremental_cleanup* cleanup, const struct fir_node* node) {
+    // A node is live if and only if it can be reached from an exported node, which is equivalent to
+    // walking up its users until an exported node is found. The nodes on the path found that way are
+    // live, while failing to find a path proves that every node visited along the way is dead.
+    bool found = is_cleanup_root(node);
+    visit_cleanup_node(cleanup, node);
+    while (!found && cleanup->stack.elem_count > 0) {
+        struct use_cursor* cursor = use_cursor_vec_last(&cleanup->stack);
+        if (!cursor->use) {
+            use_cursor_vec_pop(&cleanup->stack);
+            continue;
+        }
+        const struct fir_node* user = cursor->use->user;
+        cursor->use = cursor->use->next;
+        if (node_bitset_find(&cleanup->dead_nodes, user) || node_bitset_find(&cleanup->visited_nodes, user))
+            continue;
+        found = node_bitset_find(&cleanup->live_nodes, user) || is_cleanup_root(user);
+        visit_cleanup_node(cleanup, user);
+    }
+
+    if (found) {
+        VEC_FOREACH(struct use_cursor, cursor, cleanup->stack)
+            node_bitset_insert(&cleanup->live_nodes, cursor->node);
+    } else {
+        VEC_FOREACH(const struct fir_node*, node_ptr, cleanup->visit_list) {
+            node_bitset_insert(&cleanup->dead_nodes, *node_ptr);
+            node_vec_push(&cleanup->dead_node_list, node_ptr);
+        }
+    }
+
+    VEC_FOREACH(const struct fir_node*, node_ptr, cleanup->visit_list)
+        node_bitset_remove(&cleanup->visited_nodes, *node_ptr);
+    node_vec_clear(&cleanup->visit_list);
+    use_cursor_vec_clear(&cleanup->stack);
+    return found;
+}
+
+static void classify_node(struct incremental_cleanup* cleanup, const struct fir_node* node) {
+    if (!node_bitset_find(&cleanup->live_nodes, node) && !node_bitset_find(&cleanup->dead_nodes, node))
+        has_path_to_root(cleanup, node);
+}
+
+static void remove_dead_nominal_nodes(
+    struct fir_mod* mod,
+    struct nominal_node_vec* nodes,
+    const struct node_bitset* dead_nodes)
+{
+    size_t node_count = 0;
+    for (size_t i = 0; i < nodes->elem_count; ++i) {
+        if (!node_bitset_find(dead_nodes, nodes->elems[i]))
+            nodes->elems[node_count++] = nodes->elems[i];
+        else
+            reclaim_node(mod, nodes->elems[i]);
+    }
+    nominal_node_vec_resize(nodes, node_count);
+}
+
+void fir_mod_cleanup_incremental(struct fir_mod* mod) {
+    assert(checkpoint_vec_is_empty(&mod->checkpoints));
+    struct incremental_cleanup cleanup = {
+        .live_nodes = node_bitset_create(),
+        .dead_nodes = node_bitset_create(),
+        .visited_nodes = node_bitset_create(),
+        .dead_node_list = node_vec_create(),
+        .visit_list = node_vec_create(),
+        .stack = use_cursor_vec_create()
+    };
+
+    VEC_FOREACH(const struct fir_node*, node_ptr, mod->dirty_nodes)
+        classify_node(&cleanup, *node_ptr);
+    SHARD_FOREACH(shard, mod) {
+        VEC_FOREACH(const struct fir_node*, node_ptr, shard->dirty_nodes)
+            classify_node(&cleanup, *node_ptr);
+    }
+    clear_dirty_nodes(mod);
+
+    // Removing the uses of a dead node may in turn kill its operands, which are then classified.
+    // This grows the list of dead nodes while it is being traversed.
+    bool has_dead_funcs = false, has_dead_globals = false, has_dead_locals = false;
+    for (size_t i = 0; i < cleanup.dead_node_list.elem_count; ++i) {
+        const struct fir_node* node = cleanup.dead_node_list.elems[i];
+        has_dead_funcs   |= node->tag == FIR_FUNC;
+        has_dead_globals |= node->tag == FIR_GLOBAL;
+        has_dead_locals  |= node->tag == FIR_LOCAL;
+        for (size_t j = 0; j < node->op_count; ++j) {
+            const struct fir_node* op = node->ops[j];
+            if (!op || fir_node_is_ty(op))
+                continue;
+            forget_use(mod, node, j);
+            classify_node(&cleanup, op);
+        }
+    }
+
+    VEC_FOREACH(const struct fir_node*, node_ptr, cleanup.dead_node_list) {
+        if (!fir_node_is_nominal(*node_ptr))
+            node_table_remove(&find_shard(mod, (*node_ptr)->hash)->nodes, *node_ptr);
+    }
+    VEC_FOREACH(const struct fir_node*, node_ptr, cleanup.dead_node_list) {
+        if (!fir_node_is_nominal(*node_ptr))
+            reclaim_node(mod, (struct fir_node*)*node_ptr);
+    }
+
+    if (has_dead_funcs)
+        remove_dead_nominal_nodes(mod, &mod->funcs, &cleanup.dead_nodes);
+    if (has_dead_globals)
+        remove_dead_nominal_nodes(mod, &mod->globals, &cleanup.dead_nodes);
+    if (has_dead_locals)
+        remove_dead_nominal_nodes(mod, &mod->locals, &cleanup.dead_nodes);
+    if (cleanup.dead_node_list.elem_count > 0)
+        notify_reset(mod);
+
+    use_cursor_vec_destroy(&cleanup.stack);
+    node_vec_destroy(&cleanup.visit_list);
+    node_vec_destroy(&cleanup.dead_node_list);
+    node_bitset_destroy(&cleanup.visited_nodes);
+    node_bitset_destroy(&cleanup.dead_nodes);
+    node_bitset_destroy(&cleanup.live_nodes);
+}
+
+static void collect_nominal_nodes_by_id(const struct nominal_node_vec* nodes, struct fir_node** nodes_by_id) {
+    VEC_FOREACH(struct fir_node*, node_ptr, *nodes) {
+        nodes_by_id[(*node_ptr)->id] = *node_ptr;
+    }
+}
+
+void fir_mod_compact_ids(struct fir_mod* mod) {
+    assert(checkpoint_vec_is_empty(&mod->checkpoints));
+    // Renumbering nodes by increasing ID preserves the creation order.
+    uint32_t cur_id = atomic_load_explicit(&mod->cur_id, memory_order_relaxed);
+    struct fir_node** nodes_by_id = xcalloc(cur_id, sizeof(struct fir_node*));
+    SHARD_FOREACH(shard, mod) NODE_TABLE_FOREACH(node, shard->nodes) {
+        nodes_by_id[node->id] = (struct fir_node*)node;
+    }
+    collect_nominal_nodes_by_id(&mod->funcs, nodes_by_id);
+    collect_nominal_nodes_by_id(&mod->globals, nodes_by_id);
+    collect_nominal_nodes_by_id(&mod->locals, nodes_by_id);
+
+    uint32_t node_count = 0;
+    for (uint32_t i = 0; i < cur_id; ++i) {
+        struct fir_node* node = nodes_by_id[i];
+        if (!node)
+            continue;
+        node->id = node_count;
+        nodes_by_id[node_count++] = node;
+    }
+    atomic_store_explicit(&mod->cur_id, node_count, memory_order_relaxed);
+
+    // The hash of structural nodes depends on the IDs of their operands, so the hash-consing tables
+    // need to be rebuilt. Nodes may move to another shard in the process.
+    SHARD_FOREACH(shard, mod) {
+        memset(shard->nodes.nodes, 0, sizeof(const struct fir_node*) * shard->nodes.capacity);
+        shard->nodes.node_count = 0;
+    }
+    for (uint32_t i = 0; i < node_count; ++i) {
+        struct fir_node* node = nodes_by_id[i];
+        if (fir_node_is_nominal(node))
+            continue;
+        node->hash = hash_node(node);
+        node_table_insert(&find_shard(mod, node->hash)->nodes, node);
+    }
+    free(nodes_by_id);
+    notify_reset(mod);
+}
+
+static void set_op(struct fir_mod* mod, struct fir_node* node, size_t op_index, const struct fir_node* op) {
+    if (node->ops[op_index]) {
+        forget_use(mod, node, op_index);
+        mark_dirty(mod, node->ops[op_index]);
+    }
     node->ops[op_index] = op;
     if (op)
-        record_use(node, op_index);
+        record_use(mod, node, op_index);
+    else
+        mark_dirty(mod, node);
+    VEC_FOREACH(struct fir_mod_observer*, observer_ptr, mod->observers)
+        (*observer_ptr)->set_op(*observer_ptr, node, op_index);
 }
 
-bool fir_node_is_external(const struct fir_node* node) {
-    return node_set_find(&fir_node_mod(node)->external_nodes, &node) != NULL;
+void fir_node_set_op(struct fir_node* node, size_t op_index, const struct fir_node* op) {
+    assert(op_index < node->op_count);
+    fir_node_materialize(node);
+    struct fir_mod* mod = fir_node_mod(node);
+    record_change(mod, &(struct change) {
+        .tag = CHANGE_SET_OP,
+        .node = node,
+        .op_index = op_index,
+        .op = node->ops[op_index]
+    });
+    set_op(mod, node, op_index, op);
 }
 
 void fir_node_make_external(struct fir_node* node) {
     assert(!fir_node_is_external(node));
     assert(fir_node_can_be_external(node));
-    node_set_insert(&fir_node_mod(node)->external_nodes, (const struct fir_node**)&node);
+    struct fir_mod* mod = fir_node_mod(node);
+    lock_mutex(mod, &mod->mutex);
+    link_external_node(mod, node, mod->last_external);
+    node->props |= FIR_PROP_EXTERNAL;
+    record_change(mod, &(struct change) { .tag = CHANGE_MAKE_EXTERNAL, .node = node });
+    unlock_mutex(mod, &mod->mutex);
 }
 
 void fir_node_make_internal(struct fir_node* node) {
     assert(fir_node_is_external(node));
-    node_set_remove(&fir_node_mod(node)->external_nodes, (const struct fir_node**)&node);
+    struct fir_mod* mod = fir_node_mod(node);
+    lock_mutex(mod, &mod->mutex);
+    record_change(mod, &(struct change) {
+        .tag = CHANGE_MAKE_INTERNAL,
+        .node = node,
+        .op = node_external_link(node)->prev
+    });
+    unlink_external_node(mod, node);
+    node->props &= ~FIR_PROP_EXTERNAL;
+    unlock_mutex(mod, &mod->mutex);
+    mark_dirty(mod, node);
+}
+
+void fir_mod_add_observer(struct fir_mod* mod, struct fir_mod_observer* observer) {
+    assert(!mod->is_concurrent);
+    observer_vec_push(&mod->observers, &observer);
+}
+
+void fir_mod_remove_observer(struct fir_mod* mod, struct fir_mod_observer* observer) {
+    for (size_t i = 0; i < mod->observers.elem_count; ++i) {
+        if (mod->observers.elems[i] == observer) {
+            mod->observers.elems[i] = *observer_vec_last(&mod->observers);
+            observer_vec_pop(&mod->observers);
+            return;
+        }
+    }
+    assert(false && "observer not found");
+}
+
+static void release_binary_loader(struct fir_mod* mod) {
+    // Once every function is materialized, the binary data is no longer needed.
+    if (binary_loader_lazy_func_count(mod->binary_loader) == 0) {
+        binary_loader_destroy(mod->binary_loader);
+        mod->binary_loader = NULL;
+    }
+}
+
+void mod_set_binary_loader(struct fir_mod* mod, struct binary_loader* binary_loader) {
+    fir_mod_materialize(mod);
+    mod->binary_loader = binary_loader;
+}
+
+void fir_node_materialize(struct fir_node* node) {
+    if (!fir_node_is_lazy(node))
+        return;
+    struct fir_mod* mod = fir_node_mod(node);
+    mod->materialized_func_count += binary_loader_materialize(mod->binary_loader, node);
+    release_binary_loader(mod);
+}
+
+void fir_mod_materialize(struct fir_mod* mod) {
+    if (!mod->binary_loader)
+        return;
+    mod->materialized_func_count += binary_loader_materialize_all(mod->binary_loader);
+    release_binary_loader(mod);
+}
+
+void fir_mod_checkpoint(struct fir_mod* mod) {
+    assert(!mod->is_concurrent);
+    fir_mod_materialize(mod);
+    checkpoint_vec_push(&mod->checkpoints, &(struct checkpoint) {
+        .change_count = mod->changes.elem_count,
+        .dirty_node_count = mod->dirty_nodes.elem_count,
+        .shard_dirty_node_count = mod->shards[0].dirty_nodes.elem_count,
+        .first_id = atomic_load_explicit(&mod->cur_id, memory_order_relaxed)
+    });
+}
+
+void fir_mod_commit(struct fir_mod* mod) {
+    checkpoint_vec_pop(&mod->checkpoints);
+    if (checkpoint_vec_is_empty(&mod->checkpoints))
+        change_vec_clear(&mod->changes);
+}
+
+static void remove_last_nominal_node(struct nominal_node_vec* nodes, [[maybe_unused]] struct fir_node* node) {
+    // Nodes are removed in the reverse order of their creation, which is the order of the vector.
+    assert(*nominal_node_vec_last(nodes) == node);
+    nominal_node_vec_pop(nodes);
+}
+
+static void remove_new_node(struct fir_mod* mod, struct fir_node* node) {
+    // Nodes created after this one, or operands set after it was created, are removed first.
+    assert(!node->uses);
+    if (node->tag == FIR_FUNC)
+        remove_last_nominal_node(&mod->funcs, node);
+    else if (node->tag == FIR_GLOBAL)
+        remove_last_nominal_node(&mod->globals, node);
+    else if (node->tag == FIR_LOCAL)
+        remove_last_nominal_node(&mod->locals, node);
+    else {
+        if (!fir_node_is_ty(node)) {
+            for (size_t i = 0; i < node->op_count; ++i) {
+                if (!fir_node_is_ty(node->ops[i]))
+                    forget_use(mod, node, i);
+            }
+        }
+        node_table_remove(&find_shard(mod, node->hash)->nodes, node);
+    }
+    free_node(mod, node);
+}
+
+static void undo_change(struct fir_mod* mod, const struct change* change) {
+    switch (change->tag) {
+        case CHANGE_NEW_NODE:
+            remove_new_node(mod, change->node);
+            break;
+        case CHANGE_SET_OP:
+            set_op(mod, change->node, change->op_index, change->op);
+            break;
+        case CHANGE_MAKE_EXTERNAL:
+            unlink_external_node(mod, change->node);
+            change->node->props &= ~FIR_PROP_EXTERNAL;
+            mark_dirty(mod, change->node);
+            break;
+        case CHANGE_MAKE_INTERNAL:
+            link_external_node(mod, change->node, (struct fir_node*)change->op);
+            change->node->props |= FIR_PROP_EXTERNAL;
+            break;
+    }
+}
+
+static void remove_new_dirty_nodes(struct node_vec* dirty_nodes, size_t node_count, uint32_t first_id) {
+    // Nodes that were marked as dirty before the checkpoint are necessarily old.
+    for (size_t i = node_count; i < dirty_nodes->elem_count; ++i) {
+        if (dirty_nodes->elems[i]->id < first_id)
+            dirty_nodes->elems[node_count++] = dirty_nodes->elems[i];
+    }
+    node_vec_resize(dirty_nodes, node_count);
+}
+
+void fir_mod_rollback(struct fir_mod* mod) {
+    struct checkpoint checkpoint = *checkpoint_vec_pop(&mod->checkpoints);
+    while (mod->changes.elem_count > checkpoint.change_count)
+        undo_change(mod, change_vec_pop(&mod->changes));
+
+    // The nodes created since the checkpoint are all gone. Their memory is still owned by the
+    // module, which makes it possible to read their IDs to remove them from the dirty lists.
+    remove_new_dirty_nodes(&mod->dirty_nodes, checkpoint.dirty_node_count, checkpoint.first_id);
+    remove_new_dirty_nodes(&mod->shards[0].dirty_nodes, checkpoint.shard_dirty_node_count, checkpoint.first_id);
+    atomic_store_explicit(&mod->cur_id, checkpoint.first_id, memory_order_relaxed);
+    notify_reset(mod);
+}
+
+struct fir_node* fir_mod_first_external(const struct fir_mod* mod) {
+    return mod->first_external;
+}
+
+struct fir_node* fir_node_next_external(const struct fir_node* node) {
+    assert(fir_node_is_external(node));
+    return node_external_link(node)->next;
 }
 
 struct fir_node* const* fir_mod_funcs(const struct fir_mod* mod) {
@@ -452,6 +1253,98 @@ size_t fir_mod_global_count(const struct fir_mod* mod) {
     return mod->globals.elem_count;
 }
 
+static void add_node_mem_stats(struct fir_mem_stats* mem_stats, const struct fir_node* node) {
+    size_t size_class = node_alloc_class(node);
+    size_t use_bytes = sizeof(struct op_use) * node_size_class_capacity(size_class);
+    mem_stats->node_count++;
+    mem_stats->node_bytes += node_size_class_size(size_class) - use_bytes;
+    mem_stats->use_bytes += use_bytes;
+}
+
+static void add_nominal_nodes_mem_stats(struct fir_mem_stats* mem_stats, const struct nominal_node_vec* nodes) {
+    VEC_FOREACH(struct fir_node*, node_ptr, *nodes) {
+        add_node_mem_stats(mem_stats, *node_ptr);
+    }
+}
+
+struct fir_mem_stats fir_mod_mem_stats(const struct fir_mod* mod) {
+    struct fir_mem_stats mem_stats = { .pool_bytes = mod->nominal_allocator.pool_bytes };
+    SHARD_FOREACH(shard, mod) {
+        NODE_TABLE_FOREACH(node, shard->nodes) {
+            add_node_mem_stats(&mem_stats, node);
+        }
+        mem_stats.pool_bytes += shard->allocator.pool_bytes;
+        mem_stats.table_bytes += sizeof(const struct fir_node*) * shard->nodes.capacity;
+    }
+    add_nominal_nodes_mem_stats(&mem_stats, &mod->funcs);
+    add_nominal_nodes_mem_stats(&mem_stats, &mod->globals);
+    add_nominal_nodes_mem_stats(&mem_stats, &mod->locals);
+    return mem_stats;
+}
+
+struct fir_hash_cons_stats fir_mod_hash_cons_stats(const struct fir_mod* mod) {
+    struct fir_hash_cons_stats stats = {};
+    SHARD_FOREACH(shard, mod) {
+        stats.hit_count   += shard->nodes.stats.hit_count;
+        stats.miss_count  += shard->nodes.stats.miss_count;
+        stats.probe_count += shard->nodes.stats.probe_count;
+    }
+    return stats;
+}
+
+struct fir_reclaim_stats fir_mod_reclaim_stats(const struct fir_mod* mod) {
+    return mod->reclaim_stats;
+}
+
+static void add_free_node_stats(struct fir_mod_stats* stats, const struct node_allocator* allocator) {
+    for (size_t i = 0; i <= NODE_SIZE_CLASS_COUNT; ++i) {
+        for (const struct fir_node* node = allocator->free_nodes[i]; node; node = (const struct fir_node*)node->uses) {
+            stats->free_node_count++;
+            stats->free_node_bytes += node_size_class_size(i);
+        }
+    }
+}
+
+static void add_node_tag_counts(struct fir_mod_stats* stats, const struct nominal_node_vec* nodes) {
+    VEC_FOREACH(struct fir_node*, node_ptr, *nodes) {
+        stats->tag_counts[(*node_ptr)->tag]++;
+    }
+}
+
+struct fir_mod_stats fir_mod_stats(const struct fir_mod* mod) {
+    struct fir_mod_stats stats = {
+        .func_count = mod->funcs.elem_count,
+        .global_count = mod->globals.elem_count,
+        .local_count = mod->locals.elem_count,
+        .lazy_func_count = mod->binary_loader ? binary_loader_lazy_func_count(mod->binary_loader) : 0,
+        .materialized_func_count = mod->materialized_func_count,
+        .mem = fir_mod_mem_stats(mod),
+        .hash_cons = fir_mod_hash_cons_stats(mod)
+    };
+
+    size_t lookup_count = stats.hash_cons.hit_count + stats.hash_cons.miss_count;
+    stats.hit_rate = lookup_count > 0 ? (double)stats.hash_cons.hit_count / (double)lookup_count : 0;
+
+    SHARD_FOREACH(shard, mod) {
+        size_t mask = shard->nodes.capacity - 1;
+        NODE_TABLE_FOREACH(node, shard->nodes) {
+            stats.tag_counts[node->tag]++;
+            size_t probe_count = ((node_index - node->hash) & mask) + 1;
+            stats.probe_histogram[
+                probe_count < FIR_PROBE_HISTOGRAM_SIZE ? probe_count - 1 : FIR_PROBE_HISTOGRAM_SIZE - 1]++;
+        }
+        stats.table_capacity += shard->nodes.capacity;
+        stats.table_node_count += shard->nodes.node_count;
+        add_free_node_stats(&stats, &shard->allocator);
+    }
+    stats.table_load_factor = (double)stats.table_node_count / (double)stats.table_capacity;
+    add_free_node_stats(&stats, &mod->nominal_allocator);
+    add_node_tag_counts(&stats, &mod->funcs);
+    add_node_tag_counts(&stats, &mod->globals);
+    add_node_tag_counts(&stats, &mod->locals);
+    return stats;
+}
+
 const struct fir_node* fir_mem_ty(struct fir_mod* mod) { return mod->mem_ty; }
 const struct fir_node* fir_frame_ty(struct fir_mod* mod) { return mod->frame_ty; }
 const struct fir_node* fir_ctrl_ty(struct fir_mod* mod) { return mod->ctrl_ty; }
@@ -517,7 +1410,7 @@ const struct fir_node* fir_tup_ty(struct fir_mod* mod, const struct fir_node* co
     struct small_node small_tup_ty = {};
     struct fir_node* tup_ty = (struct fir_node*)&small_tup_ty;
     if (elem_count > SMALL_NODE_OP_COUNT)
-        tup_ty = alloc_node(elem_count);
+        tup_ty = alloc_temp_node(elem_count);
     tup_ty->tag = FIR_TUP_TY;
     tup_ty->mod = mod;
     tup_ty->op_count = elem_count;
@@ -569,13 +1462,18 @@ const struct fir_node* fir_mem_cont_ty(const struct fir_node* param_ty) {
 struct fir_node* fir_func(const struct fir_node* func_ty) {
     assert(func_ty->tag == FIR_FUNC_TY);
     struct fir_mod* mod = fir_node_mod(func_ty);
-    struct fir_node* func = alloc_node(1);
-    func->id = mod->cur_id++;
+    lock_mutex(mod, &mod->mutex);
+    struct fir_node* func = alloc_node_in_class(&mod->nominal_allocator, EXTERNAL_NODE_SIZE_CLASS);
+    func->id = next_id(mod);
     func->tag = FIR_FUNC;
     func->ty = func_ty;
     func->op_count = 1;
     func->props |= FIR_PROP_INVARIANT;
     nominal_node_vec_push(&mod->funcs, &func);
+    set_dirty(func);
+    node_vec_push(&mod->dirty_nodes, (const struct fir_node**)&func);
+    record_change(mod, &(struct change) { .tag = CHANGE_NEW_NODE, .node = func });
+    unlock_mutex(mod, &mod->mutex);
     return func;
 }
 
@@ -588,13 +1486,18 @@ static inline bool is_valid_pointee_ty(const struct fir_node* ty) {
 }
 
 struct fir_node* fir_global(struct fir_mod* mod) {
-    struct fir_node* global = alloc_node(1);
-    global->id = mod->cur_id++;
+    lock_mutex(mod, &mod->mutex);
+    struct fir_node* global = alloc_node_in_class(&mod->nominal_allocator, EXTERNAL_NODE_SIZE_CLASS);
+    global->id = next_id(mod);
     global->tag = FIR_GLOBAL;
     global->ty = fir_ptr_ty(mod);
     global->op_count = 1;
     global->props |= FIR_PROP_INVARIANT;
     nominal_node_vec_push(&mod->globals, &global);
+    set_dirty(global);
+    node_vec_push(&mod->dirty_nodes, (const struct fir_node**)&global);
+    record_change(mod, &(struct change) { .tag = CHANGE_NEW_NODE, .node = global });
+    unlock_mutex(mod, &mod->mutex);
     return global;
 }
 
@@ -1202,7 +2105,7 @@ const struct fir_node* fir_tup(
     struct small_node small_tup = {};
     struct fir_node* tup = (struct fir_node*)&small_tup;
     if (elem_count > SMALL_NODE_OP_COUNT)
-        tup = alloc_node(elem_count);
+        tup = alloc_temp_node(elem_count);
     tup->tag = FIR_TUP;
     tup->ty = tup_ty;
     tup->op_count = elem_count;
@@ -1237,7 +2140,7 @@ const struct fir_node* fir_array(
     struct small_node small_array = {};
     struct fir_node* array = (struct fir_node*)&small_array;
     if (ty->data.array_dim > SMALL_NODE_OP_COUNT)
-        array = alloc_node(ty->data.array_dim);
+        array = alloc_temp_node(ty->data.array_dim);
     array->tag = FIR_ARRAY;
     array->ty = ty;
     array->ctrl = ctrl;
@@ -1489,14 +2392,19 @@ struct fir_node* fir_local(
 {
     assert(frame->ty->tag == FIR_FRAME_TY);
     struct fir_mod* mod = fir_node_mod(frame);
-    struct fir_node* alloc = alloc_node(2);
-    alloc->id = mod->cur_id++;
+    lock_mutex(mod, &mod->mutex);
+    struct fir_node* alloc = alloc_node(&mod->nominal_allocator, 2);
+    alloc->id = next_id(mod);
     alloc->tag = FIR_LOCAL;
     alloc->ty = fir_ptr_ty(mod);
     alloc->op_count = 2;
+    nominal_node_vec_push(&mod->locals, &alloc);
+    set_dirty(alloc);
+    node_vec_push(&mod->dirty_nodes, (const struct fir_node**)&alloc);
+    record_change(mod, &(struct change) { .tag = CHANGE_NEW_NODE, .node = alloc });
+    unlock_mutex(mod, &mod->mutex);
     fir_node_set_op(alloc, 0, frame);
     fir_node_set_op(alloc, 1, init);
-    nominal_node_vec_push(&mod->locals, &alloc);
     return alloc;
 }
 
@@ -1636,7 +2544,7 @@ const struct fir_node* fir_join(
     struct small_node small_join = {};
     struct fir_node* join = (struct fir_node*)&small_join;
     if (mem_count > SMALL_NODE_OP_COUNT)
-        join = alloc_node(mem_count);
+        join = alloc_temp_node(mem_count);
     join->tag = FIR_JOIN;
     join->mod = mod;
     join->ctrl = ctrl;
@@ -183,12 +183,21 @@ static inline bool has_non_null_ops(const struct fir_node* node, bool flip) {
     return true;
 }
 
+bool fir_node_is_external(const struct fir_node* node) {
+    return (node->props & FIR_PROP_EXTERNAL) != 0;
+}
+
 bool fir_node_is_imported(const struct fir_node* node) {
-    return fir_node_is_external(node) && has_non_null_ops(node, true);
+    return fir_node_is_external(node) && !fir_node_is_lazy(node) && has_non_null_ops(node, true);
 }
 
 bool fir_node_is_exported(const struct fir_node* node) {
-    return fir_node_is_external(node) && has_non_null_ops(node, false);
+    // Lazy functions have a body, even though it is not loaded yet.
+    return fir_node_is_external(node) && (fir_node_is_lazy(node) || has_non_null_ops(node, false));
+}
+
+bool fir_node_is_lazy(const struct fir_node* node) {
+    return (node->props & FIR_PROP_LAZY) != 0;
 }
 
 bool fir_node_can_be_external(const struct fir_node* node) {
@@ -217,7 +226,7 @@ const char* fir_node_name(const struct fir_node* node) {
 char* fir_node_unique_name(const struct fir_node* node) {
     struct mem_stream mem_stream;
     mem_stream_init(&mem_stream);
-    fprintf(mem_stream.file, "%s_%"PRIu64, fir_node_name(node), node->id);
+    fprintf(mem_stream.file, "%s_%"PRIu32, fir_node_name(node), node->id);
     mem_stream_destroy(&mem_stream);
     return mem_stream.buf;
 }
@@ -240,6 +249,7 @@ const struct fir_node* fir_node_rebuild(
         case FIR_NORET_TY:    return fir_noret_ty(mod);
         case FIR_MEM_TY:      return fir_mem_ty(mod);
         case FIR_FRAME_TY:    return fir_frame_ty(mod);
+        case FIR_CTRL_TY:     return fir_ctrl_ty(mod);
         case FIR_PTR_TY:      return fir_ptr_ty(mod);
         case FIR_INT_TY:      return fir_int_ty(mod, data->bitwidth);
         case FIR_FLOAT_TY:    return fir_float_ty(mod, data->bitwidth);
@@ -273,7 +283,7 @@ const struct fir_node* fir_node_rebuild(
         case FIR_INS:    return fir_ins(ctrl, ops[0], ops[1], ops[2]);
         case FIR_ADDROF: return fir_addrof(ctrl, ops[0], ops[1], ops[2]);
         case FIR_STORE:  return fir_store(data->mem_flags, ctrl, ops[0], ops[1], ops[2]);
-        case FIR_LOAD:   return fir_load(data->mem_flags, ctrl, ops[0], ops[1], ty);
+        case FIR_LOAD:   return fir_load(data->mem_flags, ctrl, ops[0], ops[1], ty->ops[1]);
         case FIR_CALL:   return fir_call(ctrl, ops[0], ops[1]);
         case FIR_PARAM:  return fir_param(ops[0]);
         case FIR_CTRL:   return fir_ctrl(ops[0]);
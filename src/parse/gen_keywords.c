@@ -0,0 +1,86 @@
+// Generates the table used by the lexer to recognize keywords. The table is indexed by the hash of
+// the keyword, and the seed of the hash function is chosen such that every keyword gets its own
+// slot, which makes it a perfect hash table.
+
+#include "fir/node_list.h"
+
+#include "keyword_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#define KEYWORD_TABLE_SIZE 512
+
+struct keyword {
+    const char* str;
+    const char* tag;
+};
+
+static const struct keyword keywords[] = {
+#define x(tag, str) { str, "TOK_" #tag },
+    FIR_NODE_LIST(x)
+#undef x
+    { "mod",    "TOK_MOD" },
+    { "extern", "TOK_EXTERN" },
+};
+
+#define KEYWORD_COUNT (sizeof(keywords) / sizeof(keywords[0]))
+
+static inline size_t keyword_index(uint32_t seed, const char* str) {
+    return keyword_hash(seed, str, strlen(str)) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+static bool is_perfect_seed(uint32_t seed) {
+    bool is_used[KEYWORD_TABLE_SIZE] = {};
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        size_t index = keyword_index(seed, keywords[i].str);
+        if (is_used[index])
+            return false;
+        is_used[index] = true;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: gen_keywords file.h\n");
+        return 1;
+    }
+
+    uint32_t seed = 0;
+    while (!is_perfect_seed(seed)) {
+        if (++seed == 0) {
+            fprintf(stderr, "cannot find a perfect hash function for keywords\n");
+            return 1;
+        }
+    }
+
+    FILE* file = fopen(argv[1], "w");
+    if (!file) {
+        fprintf(stderr, "cannot open file '%s'\n", argv[1]);
+        return 1;
+    }
+
+    size_t max_length = 0;
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        size_t length = strlen(keywords[i].str);
+        max_length = length > max_length ? length : max_length;
+    }
+
+    fprintf(file,
+        "// Generated by gen_keywords, do not edit.\n\n"
+        "#define KEYWORD_HASH_SEED %"PRIu32"u\n"
+        "#define KEYWORD_TABLE_SIZE %d\n"
+        "#define KEYWORD_MAX_LENGTH %zu\n\n"
+        "static const struct keyword keyword_table[KEYWORD_TABLE_SIZE] = {\n",
+        seed, KEYWORD_TABLE_SIZE, max_length);
+    for (size_t i = 0; i < KEYWORD_COUNT; ++i) {
+        fprintf(file, "    [%zu] = { \"%s\", %zu, %s },\n",
+            keyword_index(seed, keywords[i].str), keywords[i].str, strlen(keywords[i].str), keywords[i].tag);
+    }
+    fprintf(file, "};\n");
+    return fclose(file) == 0 ? 0 : 1;
+}
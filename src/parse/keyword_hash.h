@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hash function used to look keywords up. The seed is chosen when the keyword table is generated,
+// so that no two keywords end up in the same slot of the table (see `gen_keywords.c`).
+static inline uint32_t keyword_hash(uint32_t seed, const char* data, size_t length) {
+    uint32_t hash = seed ^ 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
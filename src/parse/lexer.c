@@ -1,37 +1,111 @@
 #include "lexer.h"
 
-#include <ctype.h>
+#include <overture/mem.h>
+
 #include <string.h>
 #include <math.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define LEXER_BUFFER_SIZE 65536
+
+struct keyword {
+    const char* str;
+    size_t length;
+    enum token_tag tag;
+};
+
+#include "keyword_hash.h"
+#include "keyword_table.h"
+
 struct lexer lexer_create(const char* data, size_t size) {
+    struct source_pos begin_pos = { .row = 1, .col = 1 };
     return (struct lexer) {
-        .data = data,
-        .bytes_left = size,
-        .source_pos = (struct source_pos) { .row = 1, .col = 1 }
+        .cur = data,
+        .end = data + size,
+        .begin = data,
+        .begin_pos = begin_pos,
+        .known_pos = begin_pos,
+        .token_begin = data
     };
 }
 
-static inline bool is_eof(const struct lexer* lexer) {
-    return lexer->bytes_left == 0;
+struct lexer lexer_create_from_file(FILE* file) {
+    // The buffer has room for a terminating zero, which stops the conversion of literals.
+    char* buf = xmalloc(LEXER_BUFFER_SIZE + 1);
+    buf[0] = 0;
+    struct lexer lexer = lexer_create(buf, 0);
+    lexer.file = file;
+    lexer.buf = buf;
+    lexer.buf_capacity = LEXER_BUFFER_SIZE;
+    return lexer;
+}
+
+void lexer_destroy(struct lexer* lexer) {
+    free(lexer->buf);
+}
+
+static inline size_t offset_of(const struct lexer* lexer, const char* ptr) {
+    return lexer->begin_pos.bytes + (size_t)(ptr - lexer->begin);
+}
+
+struct source_pos lexer_source_pos(struct lexer* lexer, size_t bytes) {
+    if (bytes < lexer->known_pos.bytes)
+        lexer->known_pos = lexer->begin_pos;
+    assert(bytes >= lexer->known_pos.bytes);
+    assert(bytes <= offset_of(lexer, lexer->end));
+
+    struct source_pos pos = lexer->known_pos;
+    const char* ptr = lexer->begin + (pos.bytes - lexer->begin_pos.bytes);
+    const char* target = lexer->begin + (bytes - lexer->begin_pos.bytes);
+    for (const char* newline; ptr != target && (newline = memchr(ptr, '\n', target - ptr)); ptr = newline + 1) {
+        pos.row++;
+        pos.col = 1;
+    }
+    pos.col += target - ptr;
+    pos.bytes = bytes;
+    return lexer->known_pos = pos;
+}
+
+static bool refill(struct lexer* lexer) {
+    if (!lexer->file)
+        return false;
+
+    // The position of the data that is discarded is needed to compute the positions that follow.
+    lexer->begin_pos = lexer_source_pos(lexer, offset_of(lexer, lexer->token_begin));
+
+    size_t kept_size = lexer->end - lexer->token_begin;
+    memmove(lexer->buf, lexer->token_begin, kept_size);
+    if (kept_size == lexer->buf_capacity) {
+        // Tokens that do not fit in the buffer are the only reason for it to grow.
+        lexer->buf_capacity *= 2;
+        lexer->buf = xrealloc(lexer->buf, lexer->buf_capacity + 1);
+    }
+
+    size_t read_size = fread(lexer->buf + kept_size, 1, lexer->buf_capacity - kept_size, lexer->file);
+    lexer->begin = lexer->buf;
+    lexer->token_begin = lexer->buf;
+    lexer->cur = lexer->buf + kept_size;
+    lexer->end = lexer->cur + read_size;
+    lexer->buf[kept_size + read_size] = 0;
+    return read_size > 0;
+}
+
+static inline bool is_eof(struct lexer* lexer) {
+    return lexer->cur == lexer->end && !refill(lexer);
 }
 
 static inline char cur_char(const struct lexer* lexer) {
-    assert(!is_eof(lexer));
-    return lexer->data[lexer->source_pos.bytes];
+    assert(lexer->cur != lexer->end);
+    return *lexer->cur;
 }
 
 static inline void eat_char(struct lexer* lexer) {
-    assert(!is_eof(lexer));
-    if (cur_char(lexer) == '\n') {
-        lexer->source_pos.row++;
-        lexer->source_pos.col = 1;
-    } else {
-        lexer->source_pos.col++;
-    }
-    lexer->source_pos.bytes++;
-    lexer->bytes_left--;
+    assert(lexer->cur != lexer->end);
+    lexer->cur++;
 }
 
 static inline bool accept_char(struct lexer* lexer, char c) {
@@ -42,54 +116,144 @@ static inline bool accept_char(struct lexer* lexer, char c) {
     return false;
 }
 
-static inline void eat_spaces(struct lexer* lexer) {
-    while (!is_eof(lexer) && isspace(cur_char(lexer)))
-        eat_char(lexer);
+// Character classes are tested without the C library, which depends on the locale.
+enum char_class {
+    SPACE_CHARS,
+    IDENT_CHARS,
+    DIGIT_CHARS,
+    HEX_DIGIT_CHARS,
+    BIN_DIGIT_CHARS
+};
+
+static inline bool is_in_range(char c, char first, char last) {
+    return (unsigned char)(c - first) <= (unsigned char)(last - first);
 }
 
-static inline void eat_digits(struct lexer* lexer, int base) {
-    if (base == 2) {
-        while (!is_eof(lexer) && (cur_char(lexer) == '0' || cur_char(lexer) == '1'))
-            eat_char(lexer);
-    } else if (base == 16) {
-        while (!is_eof(lexer) && isxdigit(cur_char(lexer)))
-            eat_char(lexer);
-    } else {
-        assert(base == 10);
-        while (!is_eof(lexer) && isdigit(cur_char(lexer)))
-            eat_char(lexer);
+static inline bool is_alpha_char(char c) {
+    return is_in_range(c | 0x20, 'a', 'z');
+}
+
+static inline bool is_digit_char(char c) {
+    return is_in_range(c, '0', '9');
+}
+
+static inline bool is_in_class(char c, enum char_class char_class) {
+    switch (char_class) {
+        case SPACE_CHARS:     return c == ' ' || is_in_range(c, '\t', '\r');
+        case IDENT_CHARS:     return is_alpha_char(c) || is_digit_char(c) || c == '_';
+        case DIGIT_CHARS:     return is_digit_char(c);
+        case HEX_DIGIT_CHARS: return is_digit_char(c) || is_in_range(c | 0x20, 'a', 'f');
+        case BIN_DIGIT_CHARS: return c == '0' || c == '1';
+        default:
+            assert(false && "invalid character class");
+            return false;
+    }
+}
+
+// Runs of characters are scanned 16 bytes at a time when SSE2 is available. Wider vectors do not
+// help, since most tokens are shorter than that.
+#ifdef __SSE2__
+#define SIMD_WIDTH 16
+typedef __m128i simd_vec;
+static inline simd_vec simd_load(const char* p)          { return _mm_loadu_si128((const __m128i*)p); }
+static inline simd_vec simd_splat(char c)                { return _mm_set1_epi8(c); }
+static inline simd_vec simd_or(simd_vec a, simd_vec b)   { return _mm_or_si128(a, b); }
+static inline simd_vec simd_sub(simd_vec a, simd_vec b)  { return _mm_sub_epi8(a, b); }
+static inline simd_vec simd_eq(simd_vec a, simd_vec b)   { return _mm_cmpeq_epi8(a, b); }
+static inline simd_vec simd_min(simd_vec a, simd_vec b)  { return _mm_min_epu8(a, b); }
+static inline uint32_t simd_mask(simd_vec a)             { return (uint32_t)_mm_movemask_epi8(a); }
+#endif
+
+#ifdef SIMD_WIDTH
+#define SIMD_FULL_MASK ((UINT32_C(1) << SIMD_WIDTH) - 1)
+
+static inline simd_vec simd_in_range(simd_vec v, char first, char last) {
+    simd_vec offset = simd_sub(v, simd_splat(first));
+    return simd_eq(simd_min(offset, simd_splat(last - first)), offset);
+}
+
+static inline simd_vec simd_is_in_class(simd_vec v, enum char_class char_class) {
+    simd_vec lower = simd_or(v, simd_splat(0x20));
+    switch (char_class) {
+        case SPACE_CHARS:
+            return simd_or(simd_eq(v, simd_splat(' ')), simd_in_range(v, '\t', '\r'));
+        case IDENT_CHARS:
+            return simd_or(
+                simd_or(simd_in_range(lower, 'a', 'z'), simd_in_range(v, '0', '9')),
+                simd_eq(v, simd_splat('_')));
+        case DIGIT_CHARS:
+            return simd_in_range(v, '0', '9');
+        case HEX_DIGIT_CHARS:
+            return simd_or(simd_in_range(v, '0', '9'), simd_in_range(lower, 'a', 'f'));
+        case BIN_DIGIT_CHARS:
+            return simd_in_range(v, '0', '1');
+        default:
+            assert(false && "invalid character class");
+            return v;
+    }
+}
+#endif
+
+static inline const char* skip_chars(const char* cur, const char* end, enum char_class char_class) {
+#ifdef SIMD_WIDTH
+    for (; end - cur >= SIMD_WIDTH; cur += SIMD_WIDTH) {
+        uint32_t mask = simd_mask(simd_is_in_class(simd_load(cur), char_class)) ^ SIMD_FULL_MASK;
+        if (mask != 0)
+            return cur + __builtin_ctz(mask);
     }
+#endif
+    while (cur != end && is_in_class(*cur, char_class))
+        cur++;
+    return cur;
+}
+
+static inline void eat_chars(struct lexer* lexer, enum char_class char_class) {
+    do {
+        lexer->cur = skip_chars(lexer->cur, lexer->end, char_class);
+    } while (lexer->cur == lexer->end && refill(lexer));
+}
+
+static inline void eat_digits(struct lexer* lexer, int base) {
+    assert(base == 2 || base == 10 || base == 16);
+    eat_chars(lexer, base == 2 ? BIN_DIGIT_CHARS : base == 16 ? HEX_DIGIT_CHARS : DIGIT_CHARS);
 }
 
-static inline struct token make_token(
-    struct lexer* lexer,
-    const struct source_pos* begin_pos,
-    enum token_tag tag)
-{
+static inline void eat_line(struct lexer* lexer) {
+    do {
+        const char* newline = memchr(lexer->cur, '\n', lexer->end - lexer->cur);
+        lexer->cur = newline ? newline : lexer->end;
+    } while (lexer->cur == lexer->end && refill(lexer));
+}
+
+static inline struct token make_token(struct lexer* lexer, enum token_tag tag) {
     return (struct token) {
         .tag = tag,
+        .data = lexer->token_begin,
         .source_range = {
-            .begin = *begin_pos,
-            .end = lexer->source_pos
+            .begin.bytes = offset_of(lexer, lexer->token_begin),
+            .end.bytes = offset_of(lexer, lexer->cur)
         }
     };
 }
 
 static inline enum token_tag find_keyword(struct str_view ident) {
-#define x(tag, str) if (str_view_is_equal(&ident, &STR_VIEW(str))) return TOK_##tag;
-    FIR_NODE_LIST(x)
-#undef x
-    if (str_view_is_equal(&ident, &STR_VIEW("mod")))    return TOK_MOD;
-    if (str_view_is_equal(&ident, &STR_VIEW("extern"))) return TOK_EXTERN;
+    if (ident.length > KEYWORD_MAX_LENGTH)
+        return TOK_ERR;
+    uint32_t hash = keyword_hash(KEYWORD_HASH_SEED, ident.data, ident.length);
+    const struct keyword* keyword = &keyword_table[hash & (KEYWORD_TABLE_SIZE - 1)];
+    if (keyword->length == ident.length && !memcmp(keyword->str, ident.data, ident.length))
+        return keyword->tag;
     return TOK_ERR;
 }
 
 static inline struct token parse_literal(struct lexer* lexer, bool has_minus) {
     bool is_float = false;
 
+    // The sign is not part of the literal.
+    lexer->token_begin = lexer->cur;
+
     int base = 10;
     int prefix_len = 0;
-    struct source_pos begin_pos = lexer->source_pos;
     if (accept_char(lexer, '0')) {
         if (accept_char(lexer, 'b')) { base = 2; prefix_len = 2; }
         else if (accept_char(lexer, 'x')) { base = 16; prefix_len = 2; }
@@ -110,79 +274,78 @@ static inline struct token parse_literal(struct lexer* lexer, bool has_minus) {
         eat_digits(lexer, 10);
     }
 
-    struct token token = make_token(lexer, &begin_pos, is_float ? TOK_FLOAT : TOK_INT);
+    struct token token = make_token(lexer, is_float ? TOK_FLOAT : TOK_INT);
     if (is_float) {
-        token.float_val = copysign(strtod(token_str_view(lexer->data, &token).data, NULL), has_minus ? -1.0 : 1.0);
+        token.float_val = copysign(strtod(token_str_view(&token).data, NULL), has_minus ? -1.0 : 1.0);
     } else if (has_minus) {
-        long long int signed_int = -strtoll(token_str_view(lexer->data, &token).data + prefix_len, NULL, base);
+        long long int signed_int = -strtoll(token_str_view(&token).data + prefix_len, NULL, base);
         token.int_val = (uint64_t)signed_int;
     } else {
-        token.int_val = strtoull(token_str_view(lexer->data, &token).data + prefix_len, NULL, base);
+        token.int_val = strtoull(token_str_view(&token).data + prefix_len, NULL, base);
     }
     return token;
 }
 
 struct token lexer_advance(struct lexer* lexer) {
     while (true) {
-        eat_spaces(lexer);
+        lexer->token_begin = lexer->cur;
+        eat_chars(lexer, SPACE_CHARS);
 
-        struct source_pos begin_pos = lexer->source_pos;
+        lexer->token_begin = lexer->cur;
         if (is_eof(lexer))
-            return make_token(lexer, &begin_pos, TOK_EOF);
-
-        if (accept_char(lexer, '(')) return make_token(lexer, &begin_pos, TOK_LPAREN);
-        if (accept_char(lexer, ')')) return make_token(lexer, &begin_pos, TOK_RPAREN);
-        if (accept_char(lexer, '[')) return make_token(lexer, &begin_pos, TOK_LBRACKET);
-        if (accept_char(lexer, ']')) return make_token(lexer, &begin_pos, TOK_RBRACKET);
-        if (accept_char(lexer, '{')) return make_token(lexer, &begin_pos, TOK_LBRACE);
-        if (accept_char(lexer, '}')) return make_token(lexer, &begin_pos, TOK_RBRACE);
-        if (accept_char(lexer, ',')) return make_token(lexer, &begin_pos, TOK_COMMA);
-        if (accept_char(lexer, '=')) return make_token(lexer, &begin_pos, TOK_EQ);
-        if (accept_char(lexer, '@')) return make_token(lexer, &begin_pos, TOK_AT);
+            return make_token(lexer, TOK_EOF);
+
+        if (accept_char(lexer, '(')) return make_token(lexer, TOK_LPAREN);
+        if (accept_char(lexer, ')')) return make_token(lexer, TOK_RPAREN);
+        if (accept_char(lexer, '[')) return make_token(lexer, TOK_LBRACKET);
+        if (accept_char(lexer, ']')) return make_token(lexer, TOK_RBRACKET);
+        if (accept_char(lexer, '{')) return make_token(lexer, TOK_LBRACE);
+        if (accept_char(lexer, '}')) return make_token(lexer, TOK_RBRACE);
+        if (accept_char(lexer, ',')) return make_token(lexer, TOK_COMMA);
+        if (accept_char(lexer, '=')) return make_token(lexer, TOK_EQ);
+        if (accept_char(lexer, '@')) return make_token(lexer, TOK_AT);
 
         if (accept_char(lexer, '\"')) {
             while (true) {
                 if (is_eof(lexer) || cur_char(lexer) == '\n')
-                    return make_token(lexer, &begin_pos, TOK_ERR);
+                    return make_token(lexer, TOK_ERR);
                 if (accept_char(lexer, '\"'))
                     break;
                 eat_char(lexer);
             }
-            return make_token(lexer, &begin_pos, TOK_STR);
+            return make_token(lexer, TOK_STR);
         }
 
         if (accept_char(lexer, '-')) {
-            if (!is_eof(lexer) && isdigit(cur_char(lexer)))
+            if (!is_eof(lexer) && is_digit_char(cur_char(lexer)))
                 return parse_literal(lexer, true);
-            return make_token(lexer, &begin_pos, TOK_MINUS);
+            return make_token(lexer, TOK_MINUS);
         }
 
         if (accept_char(lexer, '+')) {
-            if (!is_eof(lexer) && isdigit(cur_char(lexer)))
+            if (!is_eof(lexer) && is_digit_char(cur_char(lexer)))
                 return parse_literal(lexer, false);
-            return make_token(lexer, &begin_pos, TOK_PLUS);
+            return make_token(lexer, TOK_PLUS);
         }
 
         if (accept_char(lexer, '#')) {
-            while (!is_eof(lexer) && cur_char(lexer) != '\n')
-                eat_char(lexer);
+            eat_line(lexer);
             continue;
         }
 
-        if (isalpha(cur_char(lexer)) || cur_char(lexer) == '_') {
-            while (!is_eof(lexer) && (isalnum(cur_char(lexer)) || cur_char(lexer) == '_'))
-                eat_char(lexer);
-            struct token token = make_token(lexer, &begin_pos, TOK_IDENT);
-            enum token_tag keyword_tag = find_keyword(token_str_view(lexer->data, &token));
+        if (is_alpha_char(cur_char(lexer)) || cur_char(lexer) == '_') {
+            eat_chars(lexer, IDENT_CHARS);
+            struct token token = make_token(lexer, TOK_IDENT);
+            enum token_tag keyword_tag = find_keyword(token_str_view(&token));
             if (keyword_tag != TOK_ERR)
                 token.tag = keyword_tag;
             return token;
         }
 
-        if (isdigit(cur_char(lexer)))
+        if (is_digit_char(cur_char(lexer)))
             return parse_literal(lexer, false);
 
         eat_char(lexer);
-        return make_token(lexer, &begin_pos, TOK_ERR);
+        return make_token(lexer, TOK_ERR);
     }
 }
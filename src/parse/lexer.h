@@ -2,11 +2,35 @@
 
 #include "token.h"
 
+#include <stdio.h>
+
+// The lexer only keeps track of offsets in bytes. Rows and columns are computed on demand with
+// `lexer_source_pos`, which is only needed when reporting errors.
 struct lexer {
-    const char* data;
-    size_t bytes_left;
-    struct source_pos source_pos;
+    const char* cur;
+    const char* end;
+
+    // Beginning of the part of the input that is still available, and its position.
+    const char* begin;
+    struct source_pos begin_pos;
+
+    // Last position computed by `lexer_source_pos`, from which the next one is computed.
+    struct source_pos known_pos;
+
+    // When reading from a stream, the input goes through a buffer that always holds the token
+    // being lexed. That token is moved to the beginning of the buffer when more data is read.
+    FILE* file;
+    char* buf;
+    size_t buf_capacity;
+    const char* token_begin;
 };
 
 struct lexer lexer_create(const char* data, size_t size);
+struct lexer lexer_create_from_file(FILE* file);
+void lexer_destroy(struct lexer*);
 struct token lexer_advance(struct lexer*);
+
+// Computes the row and column of a position, given its offset in bytes. This is only valid for
+// positions that are still available, which always includes the last token produced by the lexer.
+// Positions are computed from the last one, so it is faster to request them in increasing order.
+struct source_pos lexer_source_pos(struct lexer*, size_t bytes);
@@ -7,12 +7,14 @@
 #include <overture/vec.h>
 #include <overture/map.h>
 #include <overture/str.h>
+#include <overture/mem_pool.h>
 #include <overture/term.h>
 #include <overture/hash.h>
 #include <overture/bits.h>
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 #define TOKEN_LOOKAHEAD 1
 
@@ -23,26 +25,101 @@ struct parser_state {
     struct token ahead[TOKEN_LOOKAHEAD];
 };
 
-struct delayed_nominal_node {
+// The operands of nominal nodes may refer to nodes that are defined later in the file. Such an
+// operand is set as soon as the node it refers to is defined. References that are still waiting
+// for the same identifier are chained together, starting from the last one.
+struct forward_ref {
     struct fir_node* nominal_node;
-    struct parser_state parser_state;
+    size_t op_index;
+    struct str_view ident;
+    struct source_range ident_range;
+    size_t next_ref;
+    bool is_resolved;
 };
 
-VEC_DEFINE(delayed_nominal_node_vec, struct delayed_nominal_node, PRIVATE)
+// Operands of nominal nodes that are expressions containing identifiers defined later in the file
+// are recorded as a list of tokens, which is parsed again once every node is known.
+struct delayed_op {
+    struct fir_node* nominal_node;
+    size_t op_index;
+    size_t first_token;
+    size_t token_count;
+};
+
+MAP_DEFINE(forward_ref_map, struct str_view, size_t, str_view_hash, str_view_is_equal, PRIVATE)
+VEC_DEFINE(forward_ref_vec, struct forward_ref, PRIVATE)
+VEC_DEFINE(delayed_op_vec, struct delayed_op, PRIVATE)
+VEC_DEFINE(token_vec, struct token, PRIVATE)
 
 struct parser {
     struct fir_mod* mod;
     struct fir_dbg_info_pool* dbg_pool;
     struct symbol_table symbol_table;
-    struct delayed_nominal_node_vec delayed_nominal_nodes;
+    struct forward_ref_map forward_ref_map;
+    struct forward_ref_vec forward_refs;
+    struct delayed_op_vec delayed_ops;
+    struct token_vec delayed_tokens;
+    const struct token* replayed_token;
+    const struct token* last_replayed_token;
+    bool is_recording;
+    bool has_unknown_ident;
+    struct mem_pool str_pool;
     struct parser_state state;
     struct log log;
 };
 
+static inline struct str_view keep_str(struct parser*, struct str_view);
+static inline struct source_range keep_range(struct parser*, struct source_range);
+
+static inline void record_token(struct parser* parser, const struct token* token) {
+    struct token recorded_token = *token;
+    recorded_token.data = keep_str(parser, token_str_view(token)).data;
+    recorded_token.source_range = keep_range(parser, token->source_range);
+    token_vec_push(&parser->delayed_tokens, &recorded_token);
+}
+
+static inline struct token read_token(struct parser* parser) {
+    if (!parser->replayed_token)
+        return lexer_advance(&parser->state.lexer);
+    if (parser->replayed_token != parser->last_replayed_token)
+        return *(parser->replayed_token++);
+
+    // Reading past the recorded tokens produces an end-of-file token.
+    struct source_pos end_pos = parser->last_replayed_token[-1].source_range.end;
+    return (struct token) { .tag = TOK_EOF, .data = "", .source_range = { end_pos, end_pos } };
+}
+
 static inline void next_token(struct parser* parser) {
+    if (parser->is_recording)
+        record_token(parser, parser->state.ahead);
     for (size_t i = 1; i < TOKEN_LOOKAHEAD; ++i)
         parser->state.ahead[i - 1] = parser->state.ahead[i];
-    parser->state.ahead[TOKEN_LOOKAHEAD - 1] = lexer_advance(&parser->state.lexer);
+    parser->state.ahead[TOKEN_LOOKAHEAD - 1] = read_token(parser);
+}
+
+static inline struct str_view keep_str(struct parser* parser, struct str_view str) {
+    // The text of tokens read from a stream only lives until the next token is read.
+    if (!parser->state.lexer.file)
+        return str;
+    char* data = mem_pool_alloc(&parser->str_pool, str.length, 1);
+    memcpy(data, str.data, str.length);
+    return (struct str_view) { .data = data, .length = str.length };
+}
+
+static inline struct source_range resolve_range(struct parser* parser, struct source_range range) {
+    // The lexer only computes offsets in bytes. The other fields are computed when an error is
+    // reported, and a row of zero indicates that they are not known yet.
+    if (range.begin.row != 0)
+        return range;
+    return (struct source_range) {
+        .begin = lexer_source_pos(&parser->state.lexer, range.begin.bytes),
+        .end   = lexer_source_pos(&parser->state.lexer, range.end.bytes)
+    };
+}
+
+static inline struct source_range keep_range(struct parser* parser, struct source_range range) {
+    // The position of a token read from a stream can only be computed while that token is available.
+    return parser->state.lexer.file ? resolve_range(parser, range) : range;
 }
 
 static inline void eat_token(struct parser* parser, [[maybe_unused]] enum token_tag tag) {
@@ -60,9 +137,10 @@ static inline bool accept_token(struct parser* parser, enum token_tag tag) {
 
 static inline bool expect_token(struct parser* parser, enum token_tag tag) {
     if (!accept_token(parser, tag)) {
-        struct str_view str_view = token_str_view(parser->state.lexer.data, parser->state.ahead);
+        struct str_view str_view = token_str_view(parser->state.ahead);
+        struct source_range source_range = resolve_range(parser, parser->state.ahead->source_range);
         log_error(&parser->log,
-            &parser->state.ahead->source_range,
+            &source_range,
             "expected '%s', but got '%.*s'",
             token_tag_to_string(tag),
             (int)str_view.length, str_view.data);
@@ -72,9 +150,10 @@ static inline bool expect_token(struct parser* parser, enum token_tag tag) {
 }
 
 static inline void invalid_token(struct parser* parser, const char* msg) {
-    struct str_view str_view = token_str_view(parser->state.lexer.data, parser->state.ahead);
+    struct str_view str_view = token_str_view(parser->state.ahead);
+    struct source_range source_range = resolve_range(parser, parser->state.ahead->source_range);
     log_error(&parser->log,
-        &parser->state.ahead->source_range,
+        &source_range,
         "expected %s, but got '%.*s'",
         msg, (int)str_view.length, str_view.data);
     next_token(parser);
@@ -85,8 +164,9 @@ static inline void unknown_identifier(
     const struct source_range* ident_range,
     struct str_view ident)
 {
+    struct source_range source_range = resolve_range(parser, *ident_range);
     log_error(&parser->log,
-        ident_range,
+        &source_range,
         "unknown identifier '%.*s'",
         (int)ident.length, ident.data);
 }
@@ -97,7 +177,8 @@ static inline void invalid_flag(
     const char* flag_type,
     struct str_view flag_name)
 {
-    log_error(&parser->log, source_range,
+    struct source_range resolved_range = resolve_range(parser, *source_range);
+    log_error(&parser->log, &resolved_range,
         "invalid %s flag '%.*s'", flag_type, (int)flag_name.length, flag_name.data);
 }
 
@@ -118,7 +199,7 @@ static inline double parse_float_val(struct parser* parser) {
 static inline enum fir_fp_flags parse_fp_flags(struct parser* parser) {
     enum fir_fp_flags fp_flags = FIR_FP_STRICT;
     while (accept_token(parser, TOK_PLUS)) {
-        struct str_view ident = token_str_view(parser->state.lexer.data, parser->state.ahead);
+        struct str_view ident = token_str_view(parser->state.ahead);
         if (str_view_is_equal(&ident, &STR_VIEW("fo")))       fp_flags |= FIR_FP_FINITE_ONLY;
         else if (str_view_is_equal(&ident, &STR_VIEW("nsz"))) fp_flags |= FIR_FP_NO_SIGNED_ZERO;
         else if (str_view_is_equal(&ident, &STR_VIEW("a")))   fp_flags |= FIR_FP_ASSOCIATIVE;
@@ -132,7 +213,7 @@ static inline enum fir_fp_flags parse_fp_flags(struct parser* parser) {
 static inline enum fir_mem_flags parse_mem_flags(struct parser* parser) {
     enum fir_mem_flags mem_flags = 0;
     while (accept_token(parser, TOK_PLUS)) {
-        struct str_view ident = token_str_view(parser->state.lexer.data, parser->state.ahead);
+        struct str_view ident = token_str_view(parser->state.ahead);
         if (str_view_is_equal(&ident, &STR_VIEW("nn")))     mem_flags |= FIR_MEM_NON_NULL;
         else if (str_view_is_equal(&ident, &STR_VIEW("v"))) mem_flags |= FIR_MEM_VOLATILE;
         else invalid_flag(parser, &parser->state.ahead->source_range, "memory", ident);
@@ -237,7 +318,7 @@ static inline const struct fir_node* parse_ty(struct parser* parser) {
 }
 
 static inline struct str_view parse_ident(struct parser* parser) {
-    struct str_view ident = token_str_view(parser->state.lexer.data, parser->state.ahead);
+    struct str_view ident = keep_str(parser, token_str_view(parser->state.ahead));
     expect_token(parser, TOK_IDENT);
     return ident;
 }
@@ -255,10 +336,19 @@ static inline const struct fir_node* parse_op(struct parser* parser) {
     }
 
     struct source_range ident_range = parser->state.ahead->source_range;
-    struct str_view ident = parse_ident(parser);
+    struct str_view ident = token_str_view(parser->state.ahead);
     const struct fir_node* const* symbol = symbol_table_find(&parser->symbol_table, &ident);
     if (!symbol) {
-        unknown_identifier(parser, &ident_range, ident);
+        ident = keep_str(parser, ident);
+        ident_range = keep_range(parser, ident_range);
+    }
+    expect_token(parser, TOK_IDENT);
+    if (!symbol) {
+        // Expressions that are parsed speculatively are parsed again once every node is known.
+        if (parser->is_recording)
+            parser->has_unknown_ident = true;
+        else
+            unknown_identifier(parser, &ident_range, ident);
         return NULL;
     }
     return *symbol;
@@ -287,15 +377,81 @@ static inline union fir_node_data parse_node_data(
     return data;
 }
 
-static inline void skip_parens(struct parser* parser) {
-    size_t paren_depth = 1;
-    while (paren_depth > 0) {
-        if (parser->state.ahead->tag == TOK_LPAREN)
-            paren_depth++;
-        else if (parser->state.ahead->tag == TOK_RPAREN)
-            paren_depth--;
+static inline void add_forward_ref(struct parser* parser, struct fir_node* nominal_node, size_t op_index) {
+    struct source_range ident_range = keep_range(parser, parser->state.ahead->source_range);
+    struct str_view ident = keep_str(parser, token_str_view(parser->state.ahead));
+    next_token(parser);
+
+    size_t ref_index = parser->forward_refs.elem_count;
+    size_t* last_ref_index = forward_ref_map_find(&parser->forward_ref_map, &ident);
+    forward_ref_vec_push(&parser->forward_refs, &(struct forward_ref) {
+        .nominal_node = nominal_node,
+        .op_index = op_index,
+        .ident = ident,
+        .ident_range = ident_range,
+        .next_ref = last_ref_index ? *last_ref_index : SIZE_MAX
+    });
+    if (last_ref_index)
+        *last_ref_index = ref_index;
+    else
+        forward_ref_map_insert(&parser->forward_ref_map, &ident, &ref_index);
+}
+
+static inline void resolve_forward_refs(struct parser* parser, struct str_view ident, const struct fir_node* node) {
+    size_t* last_ref_index = forward_ref_map_find(&parser->forward_ref_map, &ident);
+    if (!last_ref_index)
+        return;
+
+    for (size_t i = *last_ref_index; i != SIZE_MAX;) {
+        struct forward_ref* forward_ref = &parser->forward_refs.elems[i];
+        fir_node_set_op(forward_ref->nominal_node, forward_ref->op_index, node);
+        forward_ref->is_resolved = true;
+        i = forward_ref->next_ref;
+    }
+    forward_ref_map_remove(&parser->forward_ref_map, &ident);
+}
+
+static inline void parse_nominal_op(struct parser* parser, struct fir_node* nominal_node, size_t op_index) {
+    // Nominal nodes that appear in an expression that is recorded are created again when that
+    // expression is parsed again, at which point every node is known.
+    const struct fir_node* op = NULL;
+    if (parser->is_recording || parser->replayed_token) {
+        if ((op = parse_op(parser)))
+            fir_node_set_op(nominal_node, op_index, op);
+        return;
+    }
+
+    if (parser->state.ahead->tag == TOK_IDENT) {
+        struct str_view ident = token_str_view(parser->state.ahead);
+        const struct fir_node* const* symbol = symbol_table_find(&parser->symbol_table, &ident);
+        if (!symbol) {
+            add_forward_ref(parser, nominal_node, op_index);
+            return;
+        }
         next_token(parser);
+        fir_node_set_op(nominal_node, op_index, *symbol);
+        return;
     }
+
+    size_t error_count = parser->log.error_count;
+    size_t first_token = parser->delayed_tokens.elem_count;
+    parser->is_recording = true;
+    parser->has_unknown_ident = false;
+    op = parse_op(parser);
+    parser->is_recording = false;
+
+    if (op) {
+        fir_node_set_op(nominal_node, op_index, op);
+    } else if (parser->has_unknown_ident && parser->log.error_count == error_count) {
+        delayed_op_vec_push(&parser->delayed_ops, &(struct delayed_op) {
+            .nominal_node = nominal_node,
+            .op_index = op_index,
+            .first_token = first_token,
+            .token_count = parser->delayed_tokens.elem_count - first_token
+        });
+        return;
+    }
+    token_vec_resize(&parser->delayed_tokens, first_token);
 }
 
 static inline struct fir_node* parse_nominal_node(
@@ -307,11 +463,17 @@ static inline struct fir_node* parse_nominal_node(
     struct fir_node* nominal_node = fir_node_clone(
         parser->mod, &(struct fir_node) { .tag = tag, .data = *data }, ty);
     if (accept_token(parser, TOK_LPAREN)) {
-        delayed_nominal_node_vec_push(&parser->delayed_nominal_nodes, &(struct delayed_nominal_node) {
-            .nominal_node = nominal_node,
-            .parser_state = parser->state
-        });
-        skip_parens(parser);
+        size_t op_index = 0;
+        while (parser->state.ahead->tag != TOK_RPAREN) {
+            if (op_index >= nominal_node->op_count) {
+                invalid_token(parser, "')'");
+                break;
+            }
+            parse_nominal_op(parser, nominal_node, op_index++);
+            if (!accept_token(parser, TOK_COMMA))
+                break;
+        }
+        expect_token(parser, TOK_RPAREN);
     }
     return nominal_node;
 }
@@ -326,8 +488,9 @@ static inline const struct fir_node* parse_node_body(struct parser* parser, cons
     enum fir_node_tag tag = (enum fir_node_tag)parser->state.ahead->tag;
     next_token(parser);
     if (is_external && !fir_node_tag_can_be_external(tag)) {
+        struct source_range source_range = resolve_range(parser, parser->state.ahead->source_range);
         log_error(&parser->log,
-            &parser->state.ahead->source_range,
+            &source_range,
             "node cannot be external");
     }
 
@@ -372,7 +535,7 @@ static inline const struct fir_node* parse_node(struct parser* parser) {
     if (!ty)
         return NULL;
 
-    struct source_range ident_range = parser->state.ahead->source_range;
+    struct source_range ident_range = keep_range(parser, parser->state.ahead->source_range);
     struct str_view ident = parse_ident(parser);
     expect_token(parser, TOK_EQ);
 
@@ -381,28 +544,34 @@ static inline const struct fir_node* parse_node(struct parser* parser) {
         const struct fir_node* const* symbol = symbol_table_find(&parser->symbol_table, &ident);
         assert(symbol);
         if (node != *symbol) {
+            ident_range = resolve_range(parser, ident_range);
             log_error(&parser->log,
                 &ident_range,
                 "identifier '%.*s' already exists",
                 (int)ident.length, ident.data);
         }
+    } else if (node) {
+        resolve_forward_refs(parser, ident, node);
     }
 
     return node;
 }
 
-static inline void parse_delayed_nominal_nodes(struct parser* parser) {
-    VEC_FOREACH(const struct delayed_nominal_node, delayed_nominal_node, parser->delayed_nominal_nodes) {
-        parser->state = delayed_nominal_node->parser_state;
-        size_t i = 0;
-        while (parser->state.ahead->tag != TOK_RPAREN) {
-            const struct fir_node* op = parse_op(parser);
-            if (op)
-                fir_node_set_op(delayed_nominal_node->nominal_node, i++, op);
-            if (!accept_token(parser, TOK_COMMA))
-                break;
-        }
-        expect_token(parser, TOK_RPAREN);
+static inline void parse_delayed_ops(struct parser* parser) {
+    VEC_FOREACH(const struct forward_ref, forward_ref, parser->forward_refs) {
+        if (!forward_ref->is_resolved)
+            unknown_identifier(parser, &forward_ref->ident_range, forward_ref->ident);
+    }
+
+    VEC_FOREACH(const struct delayed_op, delayed_op, parser->delayed_ops) {
+        parser->replayed_token = parser->delayed_tokens.elems + delayed_op->first_token;
+        parser->last_replayed_token = parser->replayed_token + delayed_op->token_count;
+        for (size_t i = 0; i < TOKEN_LOOKAHEAD; ++i)
+            next_token(parser);
+
+        const struct fir_node* op = parse_op(parser);
+        if (op)
+            fir_node_set_op(delayed_op->nominal_node, delayed_op->op_index, op);
     }
 }
 
@@ -410,11 +579,12 @@ static inline void parse_header(struct parser* parser) {
     if (!accept_token(parser, TOK_MOD))
         return;
 
-    struct str_view name = token_str_view(parser->state.lexer.data, parser->state.ahead);
+    struct str_view name = token_str_view(parser->state.ahead);
     if (name.length >= 2)
         name = str_view_shrink(name, 1, 1);
+    if (parser->state.ahead->tag == TOK_STR)
+        fir_mod_set_name_with_length(parser->mod, name.data, name.length);
     expect_token(parser, TOK_STR);
-    fir_mod_set_name_with_length(parser->mod, name.data, name.length);
 }
 
 bool fir_mod_parse(struct fir_mod* mod, const struct fir_parse_input* input) {
@@ -426,15 +596,22 @@ bool fir_mod_parse(struct fir_mod* mod, const struct fir_parse_input* input) {
             .disable_colors = disable_colors,
             .max_errors = SIZE_MAX,
             .source_name = input->file_name,
+            // Source excerpts cannot be shown in error messages when parsing from a stream.
             .source_data = {
-                .data = input->file_data,
-                .length = input->file_size
+                .data = input->file_stream ? NULL : input->file_data,
+                .length = input->file_stream ? 0 : input->file_size
             }
         },
         .dbg_pool = input->dbg_pool,
-        .delayed_nominal_nodes = delayed_nominal_node_vec_create(),
+        .forward_ref_map = forward_ref_map_create(),
+        .forward_refs = forward_ref_vec_create(),
+        .delayed_ops = delayed_op_vec_create(),
+        .delayed_tokens = token_vec_create(),
+        .str_pool = mem_pool_create(),
         .symbol_table = symbol_table_create(),
-        .state.lexer = lexer_create(input->file_data, input->file_size),
+        .state.lexer = input->file_stream
+            ? lexer_create_from_file(input->file_stream)
+            : lexer_create(input->file_data, input->file_size),
     };
 
     for (size_t i = 0; i < TOKEN_LOOKAHEAD; ++i)
@@ -444,9 +621,14 @@ bool fir_mod_parse(struct fir_mod* mod, const struct fir_parse_input* input) {
     while (parser.state.ahead->tag != TOK_EOF)
         parse_node(&parser);
 
-    parse_delayed_nominal_nodes(&parser);
+    parse_delayed_ops(&parser);
 
-    delayed_nominal_node_vec_destroy(&parser.delayed_nominal_nodes);
+    lexer_destroy(&parser.state.lexer);
+    mem_pool_destroy(&parser.str_pool);
+    token_vec_destroy(&parser.delayed_tokens);
+    delayed_op_vec_destroy(&parser.delayed_ops);
+    forward_ref_vec_destroy(&parser.forward_refs);
+    forward_ref_map_destroy(&parser.forward_ref_map);
     symbol_table_destroy(&parser.symbol_table);
     return parser.log.error_count == 0;
 }
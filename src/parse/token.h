@@ -35,8 +35,11 @@ enum token_tag {
     TOK_AT
 };
 
+// Tokens refer to their text, which is only valid until the lexer produces the next token. Their
+// source range only contains offsets in bytes (see `lexer_source_pos`).
 struct token {
     enum token_tag tag;
+    const char* data;
     struct source_range source_range;
     union {
         uint64_t int_val;
@@ -48,4 +51,4 @@ const char* token_tag_to_string(enum token_tag);
 bool token_tag_is_node_tag(enum token_tag);
 bool token_tag_is_ty_tag(enum token_tag);
 
-struct str_view token_str_view(const char* data, const struct token*);
+struct str_view token_str_view(const struct token*);
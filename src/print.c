@@ -6,8 +6,18 @@
 #include "analysis/schedule.h"
 
 #include <overture/term.h>
+#include <overture/bits.h>
+#include <overture/mem.h>
 
 #include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#define PRINT_BUFFER_SIZE 65536
+#define PRINT_STRING_CAPACITY 4096
 
 struct print_styles {
     const char* error_style;
@@ -31,105 +41,223 @@ static inline struct print_styles make_print_styles(bool disable_colors) {
     };
 }
 
-static void print_node(FILE*, const struct fir_node*, const struct fir_node_print_options*);
+// The printer accumulates its output in a buffer. When printing to a file, the buffer has a fixed
+// size and is written to the file when it is full. Otherwise, the buffer grows as needed and is
+// returned to the caller.
+struct printer {
+    FILE* file;
+    char* data;
+    size_t size;
+    size_t capacity;
+    struct print_styles styles;
+    enum fir_verbosity verbosity;
+};
+
+static void print_node(struct printer*, const struct fir_node*);
+
+static void flush(struct printer* printer) {
+    if (printer->file)
+        fwrite(printer->data, 1, printer->size, printer->file);
+    printer->size = 0;
+}
+
+static void print_chars(struct printer* printer, const char* data, size_t size) {
+    if (printer->size + size > printer->capacity) {
+        if (printer->file) {
+            flush(printer);
+            if (size > printer->capacity) {
+                fwrite(data, 1, size, printer->file);
+                return;
+            }
+        } else {
+            while (printer->size + size > printer->capacity)
+                printer->capacity = printer->capacity * 2 + 1;
+            printer->data = xrealloc(printer->data, printer->capacity);
+        }
+    }
+    memcpy(printer->data + printer->size, data, size);
+    printer->size += size;
+}
+
+static inline void print_str(struct printer* printer, const char* str) {
+    print_chars(printer, str, strlen(str));
+}
+
+static inline void print_char(struct printer* printer, char c) {
+    print_chars(printer, &c, 1);
+}
+
+static void print_uint(struct printer* printer, uint64_t value) {
+    char digits[20];
+    size_t digit_count = 0;
+    do {
+        digits[sizeof(digits) - 1 - digit_count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    print_chars(printer, digits + sizeof(digits) - digit_count, digit_count);
+}
+
+static void print_hex_float(struct printer* printer, double value) {
+    // This produces the same output as the `%a` format specifier of `printf`.
+    uint64_t bits = double_to_bits(value);
+    uint64_t exponent_bits = (bits >> 52) & 0x7FF;
+    uint64_t mantissa = bits & make_bitmask(52);
+    if (bits >> 63)
+        print_char(printer, '-');
+    if (exponent_bits == 0x7FF) {
+        print_str(printer, mantissa != 0 ? "nan" : "inf");
+        return;
+    }
+
+    int64_t exponent = 0;
+    if (exponent_bits != 0) {
+        print_str(printer, "0x1");
+        exponent = (int64_t)exponent_bits - 1023;
+    } else {
+        print_str(printer, "0x0");
+        exponent = mantissa != 0 ? -1022 : 0;
+    }
+
+    if (mantissa != 0) {
+        size_t digit_count = 13;
+        for (; (mantissa & 0xF) == 0; mantissa >>= 4)
+            digit_count--;
+        char digits[14] = { '.' };
+        for (size_t i = digit_count; i > 0; --i, mantissa >>= 4)
+            digits[i] = "0123456789abcdef"[mantissa & 0xF];
+        print_chars(printer, digits, digit_count + 1);
+    }
+
+    print_str(printer, exponent < 0 ? "p-" : "p+");
+    print_uint(printer, exponent < 0 ? -exponent : exponent);
+}
 
-static inline void print_indent(FILE* file, size_t indent, const char* tab) {
+static inline void print_indent(struct printer* printer, size_t indent, const char* tab) {
     for (size_t i = 0; i < indent; ++i)
-        fputs(tab, file);
+        print_str(printer, tab);
 }
 
-static void print_fp_flags(FILE* file, enum fir_fp_flags flags) {
-    if (flags & FIR_FP_FINITE_ONLY)    fprintf(file, "+fo");
-    if (flags & FIR_FP_NO_SIGNED_ZERO) fprintf(file, "+nsz");
-    if (flags & FIR_FP_ASSOCIATIVE)    fprintf(file, "+a");
-    if (flags & FIR_FP_DISTRIBUTIVE)   fprintf(file, "+d");
+static void print_fp_flags(struct printer* printer, enum fir_fp_flags flags) {
+    if (flags & FIR_FP_FINITE_ONLY)    print_str(printer, "+fo");
+    if (flags & FIR_FP_NO_SIGNED_ZERO) print_str(printer, "+nsz");
+    if (flags & FIR_FP_ASSOCIATIVE)    print_str(printer, "+a");
+    if (flags & FIR_FP_DISTRIBUTIVE)   print_str(printer, "+d");
 }
 
-static void print_mem_flags(FILE* file, enum fir_mem_flags flags) {
-    if (flags & FIR_MEM_NON_NULL) fprintf(file, "+nn");
-    if (flags & FIR_MEM_VOLATILE) fprintf(file, "+v");
+static void print_mem_flags(struct printer* printer, enum fir_mem_flags flags) {
+    if (flags & FIR_MEM_NON_NULL) print_str(printer, "+nn");
+    if (flags & FIR_MEM_VOLATILE) print_str(printer, "+v");
 }
 
-static void print_node_name(FILE* file, const struct fir_node* node) {
-    fprintf(file, "%s_%"PRIu64, fir_node_name(node), node->id);
+static void print_node_name(struct printer* printer, const struct fir_node* node) {
+    print_str(printer, fir_node_name(node));
+    print_char(printer, '_');
+    print_uint(printer, node->id);
 }
 
-static void print_op(
-    FILE* file,
-    const struct fir_node* op,
-    const struct fir_node_print_options* print_options)
-{
-    struct print_styles print_styles = make_print_styles(print_options->disable_colors);
-    if (!op)
-        fprintf(file, "%s<unset>%s", print_styles.error_style, print_styles.reset_style);
-    else if (!fir_node_is_nominal(op) && (op->props & FIR_PROP_INVARIANT) != 0) {
+static void print_op(struct printer* printer, const struct fir_node* op) {
+    if (!op) {
+        print_str(printer, printer->styles.error_style);
+        print_str(printer, "<unset>");
+        print_str(printer, printer->styles.reset_style);
+    } else if (!fir_node_is_nominal(op) && (op->props & FIR_PROP_INVARIANT) != 0) {
         if (!fir_node_is_ty(op)) {
-            print_node(file, op->ty, print_options);
-            fprintf(file, " ");
+            print_node(printer, op->ty);
+            print_char(printer, ' ');
         }
-        print_node(file, op, print_options);
+        print_node(printer, op);
     } else
-        print_node_name(file, op);
+        print_node_name(printer, op);
 }
 
-static void print_node(
-    FILE* file,
-    const struct fir_node* node,
-    const struct fir_node_print_options* print_options)
-{
-    struct print_styles print_styles = make_print_styles(print_options->disable_colors);
-    if (fir_node_is_external(node))
-        fprintf(file, "%sextern%s ", print_styles.keyword_style, print_styles.reset_style);
-    fprintf(file, "%s%s%s",
-        fir_node_is_ty(node) ? print_styles.type_style : print_styles.value_style,
-        fir_node_tag_to_string(node->tag),
-        print_styles.reset_style);
-    if (fir_node_has_bitwidth(node))
-        fprintf(file, "[%s%zu%s]", print_styles.data_style, node->data.bitwidth, print_styles.reset_style);
-    else if (node->tag == FIR_CONST && node->ty->tag == FIR_INT_TY)
-        fprintf(file, "[%s%"PRIu64"%s]", print_styles.data_style, node->data.int_val, print_styles.reset_style);
-    else if (node->tag == FIR_CONST && node->ty->tag == FIR_FLOAT_TY)
-        fprintf(file, "[%s%a%s]", print_styles.data_style, node->data.float_val, print_styles.reset_style);
-    else if (node->tag == FIR_ARRAY_TY)
-        fprintf(file, "[%s%zu%s]", print_styles.data_style, node->data.array_dim, print_styles.reset_style);
-    else if (fir_node_has_mem_flags(node)) {
-        fprintf(file, "[%s", print_styles.data_style);
-        print_mem_flags(file, node->data.mem_flags);
-        fprintf(file, "%s]", print_styles.reset_style);
+static inline void print_data_begin(struct printer* printer) {
+    print_char(printer, '[');
+    print_str(printer, printer->styles.data_style);
+}
+
+static inline void print_data_end(struct printer* printer) {
+    print_str(printer, printer->styles.reset_style);
+    print_char(printer, ']');
+}
+
+static void print_node(struct printer* printer, const struct fir_node* node) {
+    const struct print_styles* styles = &printer->styles;
+    if (fir_node_is_external(node)) {
+        print_str(printer, styles->keyword_style);
+        print_str(printer, "extern");
+        print_str(printer, styles->reset_style);
+        print_char(printer, ' ');
+    }
+    print_str(printer, fir_node_is_ty(node) ? styles->type_style : styles->value_style);
+    print_str(printer, fir_node_tag_to_string(node->tag));
+    print_str(printer, styles->reset_style);
+    if (fir_node_has_bitwidth(node)) {
+        print_data_begin(printer);
+        print_uint(printer, node->data.bitwidth);
+        print_data_end(printer);
+    } else if (node->tag == FIR_CONST && node->ty->tag == FIR_INT_TY) {
+        print_data_begin(printer);
+        print_uint(printer, node->data.int_val);
+        print_data_end(printer);
+    } else if (node->tag == FIR_CONST && node->ty->tag == FIR_FLOAT_TY) {
+        print_data_begin(printer);
+        print_hex_float(printer, node->data.float_val);
+        print_data_end(printer);
+    } else if (node->tag == FIR_ARRAY_TY) {
+        print_data_begin(printer);
+        print_uint(printer, node->data.array_dim);
+        print_data_end(printer);
+    } else if (fir_node_has_mem_flags(node)) {
+        print_data_begin(printer);
+        print_mem_flags(printer, node->data.mem_flags);
+        print_data_end(printer);
     } else if (fir_node_has_fp_flags(node)) {
-        fprintf(file, "[%s", print_styles.data_style);
-        print_fp_flags(file, node->data.fp_flags);
-        fprintf(file, "%s]", print_styles.reset_style);
+        print_data_begin(printer);
+        print_fp_flags(printer, node->data.fp_flags);
+        print_data_end(printer);
     }
     if (node->op_count == 0)
         return;
-    fprintf(file, "(");
+    print_char(printer, '(');
     for (size_t i = 0; i < node->op_count; ++i) {
-        print_op(file, node->ops[i], print_options);
+        print_op(printer, node->ops[i]);
         if (i != node->op_count - 1)
-            fprintf(file, ", ");
+            print_str(printer, ", ");
     }
-    fprintf(file, ")");
-    if (node->ctrl && print_options->verbosity != FIR_VERBOSITY_COMPACT) {
-        fprintf(file, "@");
-        print_op(file, node->ctrl, print_options);
+    print_char(printer, ')');
+    if (node->ctrl && printer->verbosity != FIR_VERBOSITY_COMPACT) {
+        print_char(printer, '@');
+        print_op(printer, node->ctrl);
     }
 }
 
+static void print_node_def(struct printer* printer, const struct fir_node* node) {
+    if (!fir_node_is_ty(node)) {
+        if (printer->verbosity != FIR_VERBOSITY_COMPACT) {
+            print_node(printer, node->ty);
+            print_char(printer, ' ');
+        }
+        print_node_name(printer, node);
+        print_str(printer, " = ");
+    }
+    print_node(printer, node);
+}
+
 void fir_node_print(
     FILE* file,
     const struct fir_node* node,
     const struct fir_node_print_options* print_options)
 {
-    if (!fir_node_is_ty(node)) {
-        if (print_options->verbosity != FIR_VERBOSITY_COMPACT) {
-            print_node(file, node->ty, print_options);
-            fprintf(file, " ");
-        }
-        print_node_name(file, node);
-        fprintf(file, " = ");
-    }
-    print_node(file, node, print_options);
+    char buf[1024];
+    struct printer printer = {
+        .file = file,
+        .data = buf,
+        .capacity = sizeof(buf),
+        .styles = make_print_styles(print_options->disable_colors),
+        .verbosity = print_options->verbosity
+    };
+    print_node_def(&printer, node);
+    flush(&printer);
 }
 
 void fir_node_dump(const struct fir_node* node) {
@@ -141,82 +269,229 @@ void fir_node_dump(const struct fir_node* node) {
     fflush(stdout);
 }
 
-void fir_mod_print(FILE* file, const struct fir_mod* mod, const struct fir_mod_print_options* print_options) {
-    struct print_styles print_styles = make_print_styles(print_options->disable_colors);
-    fprintf(file, "%smod%s \"%.*s\"\n\n",
-        print_styles.keyword_style, print_styles.reset_style,
-        (int)strlen(fir_mod_name(mod)), fir_mod_name(mod));
+static void print_func(
+    struct printer* printer,
+    const struct fir_node* func,
+    const struct fir_mod_print_options* print_options)
+{
+    print_indent(printer, print_options->indent, print_options->tab);
+    print_node_def(printer, func);
+    print_char(printer, '\n');
+    if (!func->ops[0])
+        return;
+
+    struct scope scope = scope_create(func);
+    struct cfg cfg = cfg_create(&scope);
+    struct schedule schedule = schedule_create(&cfg);
+
+    VEC_REV_FOREACH(struct graph_node*, block_ptr, cfg.post_order) {
+        if ((*block_ptr) == cfg.graph.sink)
+            continue;
+
+        print_indent(printer, print_options->indent + 1, print_options->tab);
+        print_node_def(printer, cfg_block_func(*block_ptr));
+        print_char(printer, '\n');
+    }
+    print_char(printer, '\n');
+
+    struct node_vec* block_contents = xmalloc(sizeof(struct node_vec) * cfg.graph.node_count);
+    for (size_t i = 0; i < cfg.graph.node_count; ++i)
+        block_contents[i] = node_vec_create();
+    schedule_list_block_contents(&schedule, block_contents);
+
+    VEC_REV_FOREACH(struct graph_node*, block_ptr, cfg.post_order) {
+        if ((*block_ptr) == cfg.graph.sink)
+            continue;
+
+        const struct fir_node* block_func = cfg_block_func(*block_ptr);
+        print_indent(printer, print_options->indent + 1, print_options->tab);
+        print_str(printer, printer->styles.comment_style);
+        print_char(printer, '#');
+        print_node_name(printer, block_func);
+        print_str(printer, ": ");
+        print_str(printer, printer->styles.reset_style);
+        print_char(printer, '\n');
+
+        VEC_FOREACH(const struct fir_node*, node_ptr, block_contents[(*block_ptr)->index]) {
+            print_indent(printer, print_options->indent + 2, print_options->tab);
+            print_node_def(printer, *node_ptr);
+            print_char(printer, '\n');
+        }
+        print_char(printer, '\n');
+    }
+
+    for (size_t i = 0; i < cfg.graph.node_count; ++i)
+        node_vec_destroy(&block_contents[i]);
+    free(block_contents);
+    schedule_destroy(&schedule);
+    scope_destroy(&scope);
+    cfg_destroy(&cfg);
+}
+
+// When functions are printed in parallel, each function is printed into its own buffer, and the
+// buffers are emitted in the order of the functions in the module as soon as they are ready.
+struct print_job {
+    const struct fir_node* func;
+    char* data;
+    size_t size;
+    bool is_done;
+};
+
+struct print_job_queue {
+    struct print_job* jobs;
+    size_t job_count;
+    atomic_size_t next_job;
+    const struct printer* printer;
+    const struct fir_mod_print_options* print_options;
+    pthread_mutex_t mutex;
+    pthread_cond_t done_cond;
+};
+
+static void* run_print_jobs(void* data) {
+    struct print_job_queue* job_queue = data;
+    while (true) {
+        size_t job_index = atomic_fetch_add_explicit(&job_queue->next_job, 1, memory_order_relaxed);
+        if (job_index >= job_queue->job_count)
+            break;
+
+        struct print_job* job = &job_queue->jobs[job_index];
+        struct printer printer = {
+            .data = xmalloc(PRINT_STRING_CAPACITY),
+            .capacity = PRINT_STRING_CAPACITY,
+            .styles = job_queue->printer->styles,
+            .verbosity = job_queue->printer->verbosity
+        };
+        print_func(&printer, job->func, job_queue->print_options);
+
+        pthread_mutex_lock(&job_queue->mutex);
+        job->data = printer.data;
+        job->size = printer.size;
+        job->is_done = true;
+        pthread_cond_broadcast(&job_queue->done_cond);
+        pthread_mutex_unlock(&job_queue->mutex);
+    }
+    return NULL;
+}
+
+static void print_funcs_in_parallel(
+    struct printer* printer,
+    const struct fir_node* const* funcs,
+    size_t func_count,
+    const struct fir_mod_print_options* print_options)
+{
+    struct print_job_queue job_queue = {
+        .jobs = xcalloc(func_count, sizeof(struct print_job)),
+        .job_count = func_count,
+        .printer = printer,
+        .print_options = print_options
+    };
+    pthread_mutex_init(&job_queue.mutex, NULL);
+    pthread_cond_init(&job_queue.done_cond, NULL);
+    for (size_t i = 0; i < func_count; ++i)
+        job_queue.jobs[i].func = funcs[i];
+
+    size_t thread_count = print_options->thread_count < func_count ? print_options->thread_count : func_count;
+    pthread_t* threads = xmalloc(sizeof(pthread_t) * thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_create(&threads[i], NULL, run_print_jobs, &job_queue);
+
+    for (size_t i = 0; i < func_count; ++i) {
+        struct print_job* job = &job_queue.jobs[i];
+        pthread_mutex_lock(&job_queue.mutex);
+        while (!job->is_done)
+            pthread_cond_wait(&job_queue.done_cond, &job_queue.mutex);
+        pthread_mutex_unlock(&job_queue.mutex);
+
+        print_chars(printer, job->data, job->size);
+        free(job->data);
+    }
+
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_cond_destroy(&job_queue.done_cond);
+    pthread_mutex_destroy(&job_queue.mutex);
+    free(job_queue.jobs);
+}
+
+static void print_mod(
+    struct printer* printer,
+    const struct fir_mod* mod,
+    const struct fir_mod_print_options* print_options)
+{
+    print_str(printer, printer->styles.keyword_style);
+    print_str(printer, "mod");
+    print_str(printer, printer->styles.reset_style);
+    print_str(printer, " \"");
+    print_str(printer, fir_mod_name(mod));
+    print_str(printer, "\"\n\n");
 
     struct fir_node* const* globals = fir_mod_globals(mod);
     struct fir_node* const* funcs = fir_mod_funcs(mod);
     size_t func_count = fir_mod_func_count(mod);
     size_t global_count = fir_mod_global_count(mod);
 
-    const struct fir_node_print_options node_print_options = {
-        .verbosity = print_options->verbosity,
-        .disable_colors = print_options->disable_colors
-    };
-
     for (size_t i = 0; i < global_count; ++i) {
-        print_indent(file, print_options->indent, print_options->tab);
-        fir_node_print(file, globals[i], &node_print_options);
-        fprintf(file, "\n");
+        print_indent(printer, print_options->indent, print_options->tab);
+        print_node_def(printer, globals[i]);
+        print_char(printer, '\n');
     }
 
+    // Lazy functions are materialized up front, since loading them modifies the module.
+    const struct fir_node** printed_funcs = xmalloc(sizeof(struct fir_node*) * func_count);
+    size_t printed_func_count = 0;
     for (size_t i = 0; i < func_count; ++i) {
         if (funcs[i]->ty->ops[1]->tag == FIR_NORET_TY)
             continue;
 
-        print_indent(file, print_options->indent, print_options->tab);
-        fir_node_print(file, funcs[i], &node_print_options);
-        fprintf(file, "\n");
-        if (!funcs[i]->ops[0])
-            continue;
+        fir_node_materialize(funcs[i]);
+        printed_funcs[printed_func_count++] = funcs[i];
+    }
 
-        struct scope scope = scope_create(funcs[i]);
-        struct cfg cfg = cfg_create(&scope);
-        struct schedule schedule = schedule_create(&cfg);
+    // For the same reason, the nodes that the analyses look up are created before the threads start,
+    // so that they only ever find existing nodes. This is done once every function is materialized,
+    // so that the IDs of the loaded nodes, and therefore their names, are the same as when printing
+    // sequentially.
+    bool is_parallel = print_options->thread_count > 1 && fir_mod_is_concurrent(mod);
+    for (size_t i = 0; is_parallel && i < printed_func_count; ++i) {
+        if (!printed_funcs[i]->ops[0])
+            continue;
+        fir_param(printed_funcs[i]);
+        fir_node_func_return(printed_funcs[i]);
+    }
 
-        VEC_REV_FOREACH(struct graph_node*, block_ptr, cfg.post_order) {
-            if ((*block_ptr) == cfg.graph.sink)
-                continue;
+    if (is_parallel && printed_func_count > 1) {
+        print_funcs_in_parallel(printer, printed_funcs, printed_func_count, print_options);
+    } else {
+        for (size_t i = 0; i < printed_func_count; ++i)
+            print_func(printer, printed_funcs[i], print_options);
+    }
+    free(printed_funcs);
+}
 
-            print_indent(file, print_options->indent + 1, print_options->tab);
-            fir_node_print(file, cfg_block_func(*block_ptr), &node_print_options);
-            fprintf(file, "\n");
-        }
-        fprintf(file, "\n");
-
-        struct node_vec* block_contents = xmalloc(sizeof(struct node_vec) * cfg.graph.node_count);
-        for (size_t i = 0; i < cfg.graph.node_count; ++i)
-            block_contents[i] = node_vec_create();
-        schedule_list_block_contents(&schedule, block_contents);
-
-        VEC_REV_FOREACH(struct graph_node*, block_ptr, cfg.post_order) {
-            if ((*block_ptr) == cfg.graph.sink)
-                continue;
-
-            const struct fir_node* block_func = cfg_block_func(*block_ptr);
-            print_indent(file, print_options->indent + 1, print_options->tab);
-            fprintf(file, "%s#", print_styles.comment_style);
-            print_node_name(file, block_func);
-            fprintf(file, ": %s\n", print_styles.reset_style);
-
-            VEC_FOREACH(const struct fir_node*, node_ptr, block_contents[(*block_ptr)->index]) {
-                print_indent(file, print_options->indent + 2, print_options->tab);
-                fir_node_print(file, *node_ptr, &node_print_options);
-                fprintf(file, "\n");
-            }
-            fprintf(file, "\n");
-        }
+void fir_mod_print(FILE* file, const struct fir_mod* mod, const struct fir_mod_print_options* print_options) {
+    char buf[PRINT_BUFFER_SIZE];
+    struct printer printer = {
+        .file = file,
+        .data = buf,
+        .capacity = sizeof(buf),
+        .styles = make_print_styles(print_options->disable_colors),
+        .verbosity = print_options->verbosity
+    };
+    print_mod(&printer, mod, print_options);
+    flush(&printer);
+}
 
-        for (size_t i = 0; i < cfg.graph.node_count; ++i)
-            node_vec_destroy(&block_contents[i]);
-        free(block_contents);
-        schedule_destroy(&schedule);
-        scope_destroy(&scope);
-        cfg_destroy(&cfg);
-    }
+char* fir_mod_print_to_string(const struct fir_mod* mod, const struct fir_mod_print_options* print_options) {
+    struct printer printer = {
+        .data = xmalloc(PRINT_STRING_CAPACITY),
+        .capacity = PRINT_STRING_CAPACITY,
+        .styles = make_print_styles(print_options->disable_colors),
+        .verbosity = print_options->verbosity
+    };
+    print_mod(&printer, mod, print_options);
+    print_char(&printer, 0);
+    return printer.data;
 }
 
 void fir_mod_dump(const struct fir_mod* mod) {
@@ -0,0 +1,105 @@
+#include "analysis/manager.h"
+#include "analysis/scope.h"
+
+#include <overture/test.h>
+
+#include <fir/module.h>
+#include <fir/block.h>
+#include <fir/node.h>
+
+static inline struct fir_node* build_add(struct fir_mod* mod, struct fir_block* entry) {
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    const struct fir_node* mem_ty = fir_mem_ty(mod);
+    const struct fir_node* param_ty = fir_tup_ty(mod,
+        (const struct fir_node*[]) { mem_ty, int32_ty, int32_ty }, 3);
+    const struct fir_node* ret_ty = fir_tup_ty(mod,
+        (const struct fir_node*[]) { mem_ty, int32_ty }, 2);
+
+    // return x + y
+    struct fir_node* add = fir_func(fir_func_ty(param_ty, ret_ty));
+    const struct fir_node* param = fir_block_start(entry, add);
+    const struct fir_node* x = fir_ext_at(NULL, param, 0);
+    const struct fir_node* y = fir_ext_at(NULL, param, 1);
+    fir_block_return(entry, fir_iarith_op(FIR_IADD, NULL, x, y));
+    fir_node_make_external(add);
+    return add;
+}
+
+static inline bool has_stats(
+    const struct analysis_manager* manager,
+    enum analysis_tag tag,
+    struct analysis_stats expected_stats)
+{
+    const struct analysis_stats* stats = analysis_manager_stats(manager, tag);
+    return
+        stats->hit_count == expected_stats.hit_count &&
+        stats->miss_count == expected_stats.miss_count &&
+        stats->invalidation_count == expected_stats.invalidation_count &&
+        stats->update_count == expected_stats.update_count;
+}
+
+TEST(analysis_manager_cache) {
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_block entry;
+    struct fir_node* add = build_add(mod, &entry);
+    struct analysis_manager* manager = analysis_manager_create(mod);
+
+    struct schedule* schedule = analysis_manager_schedule(manager, add);
+    REQUIRE(analysis_manager_schedule(manager, add) == schedule);
+    REQUIRE(analysis_manager_scope(manager, add)->func == add);
+    REQUIRE(has_stats(manager, ANALYSIS_SCOPE, (struct analysis_stats) { .hit_count = 1, .miss_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_CFG, (struct analysis_stats) { .miss_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_SCHEDULE, (struct analysis_stats) { .hit_count = 1, .miss_count = 1 }));
+
+    // Cleaning up the module may free nodes, which invalidates everything.
+    fir_mod_cleanup(mod);
+    analysis_manager_cfg(manager, add);
+    REQUIRE(has_stats(manager, ANALYSIS_SCOPE, (struct analysis_stats) { .hit_count = 1, .miss_count = 2, .invalidation_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_CFG, (struct analysis_stats) { .miss_count = 2, .invalidation_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_SCHEDULE, (struct analysis_stats) { .hit_count = 1, .miss_count = 1, .invalidation_count = 1 }));
+
+    analysis_manager_destroy(manager);
+    fir_mod_destroy(mod);
+}
+
+TEST(analysis_manager_invalidation) {
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_block add_entry, other_add_entry;
+    struct fir_node* add = build_add(mod, &add_entry);
+    struct fir_node* other_add = build_add(mod, &other_add_entry);
+    struct analysis_manager* manager = analysis_manager_create(mod);
+
+    analysis_manager_schedule(manager, add);
+    analysis_manager_schedule(manager, other_add);
+
+    // Changing a block of a function only affects the analyses of that function. Its scope is
+    // updated, while the other analyses are computed again.
+    fir_node_set_op(add_entry.block, 0, add_entry.block->ops[0]);
+    analysis_manager_schedule(manager, add);
+    analysis_manager_schedule(manager, other_add);
+    REQUIRE(has_stats(manager, ANALYSIS_SCOPE, (struct analysis_stats) { .hit_count = 1, .miss_count = 2, .update_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_CFG, (struct analysis_stats) { .miss_count = 3, .invalidation_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_SCHEDULE, (struct analysis_stats) { .hit_count = 1, .miss_count = 3, .invalidation_count = 1 }));
+
+    // Preserved analyses are kept, along with the analyses they are built from.
+    analysis_manager_preserve(manager, ANALYSIS_PRESERVE_SCOPE | ANALYSIS_PRESERVE_CFG);
+    fir_node_set_op(add_entry.block, 0, add_entry.block->ops[0]);
+    analysis_manager_preserve(manager, ANALYSIS_PRESERVE_NONE);
+    analysis_manager_schedule(manager, add);
+    REQUIRE(has_stats(manager, ANALYSIS_SCOPE, (struct analysis_stats) { .hit_count = 1, .miss_count = 2, .update_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_CFG, (struct analysis_stats) { .hit_count = 1, .miss_count = 3, .invalidation_count = 1 }));
+    REQUIRE(has_stats(manager, ANALYSIS_SCHEDULE, (struct analysis_stats) { .hit_count = 1, .miss_count = 4, .invalidation_count = 2 }));
+
+    // Giving an operand that depends on a function to a node outside of it brings that node into
+    // the scope of the function.
+    struct fir_node* global = fir_global(mod);
+    const struct fir_node* x = fir_ext_at(NULL, fir_node_chop(fir_param(other_add), 1), 0);
+    REQUIRE(!scope_contains(analysis_manager_scope(manager, other_add), global));
+    fir_node_set_op(global, 0, fir_iarith_op(FIR_IMUL, NULL, x, x));
+    REQUIRE(scope_contains(analysis_manager_scope(manager, other_add), global));
+    REQUIRE(!scope_contains(analysis_manager_scope(manager, add), global));
+    REQUIRE(analysis_manager_stats(manager, ANALYSIS_SCOPE)->update_count == 2);
+
+    analysis_manager_destroy(manager);
+    fir_mod_destroy(mod);
+}
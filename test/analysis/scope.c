@@ -0,0 +1,71 @@
+#include "analysis/scope.h"
+
+#include <overture/test.h>
+
+#include <fir/module.h>
+#include <fir/block.h>
+#include <fir/node.h>
+
+static inline bool is_same_as_new_scope(const struct scope* scope) {
+    struct scope new_scope = scope_create(scope->func);
+    bool is_same =
+        new_scope.members.elem_count == scope->members.elem_count &&
+        new_scope.blocks.elem_count == scope->blocks.elem_count;
+    for (size_t i = 0; is_same && i < new_scope.members.elem_count; ++i)
+        is_same &= scope_contains(scope, new_scope.members.elems[i]);
+    for (size_t i = 0; is_same && i < new_scope.blocks.elem_count; ++i)
+        is_same &= new_scope.blocks.elems[i] == scope->blocks.elems[i];
+    scope_destroy(&new_scope);
+    return is_same;
+}
+
+static inline void set_op(struct scope* scope, struct fir_node* node, const struct fir_node* op) {
+    fir_node_set_op(node, 0, op);
+    scope_update(scope, node);
+}
+
+TEST(scope_update) {
+    struct fir_mod* mod = fir_mod_create("module");
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    const struct fir_node* mem_ty = fir_mem_ty(mod);
+    const struct fir_node* param_ty = fir_tup_ty(mod,
+        (const struct fir_node*[]) { mem_ty, int32_ty }, 2);
+
+    // return x
+    struct fir_node* func = fir_func(fir_func_ty(param_ty, param_ty));
+    struct fir_block entry;
+    const struct fir_node* x = fir_block_start(&entry, func);
+    fir_block_return(&entry, x);
+    struct scope scope = scope_create(func);
+
+    // Nodes outside of the scope join it when they are given an operand that depends on it, and
+    // leave it when that operand is replaced.
+    struct fir_node* global = fir_global(mod);
+    set_op(&scope, global, fir_iarith_op(FIR_IMUL, NULL, x, x));
+    REQUIRE(scope_contains(&scope, global));
+    REQUIRE(is_same_as_new_scope(&scope));
+    set_op(&scope, global, fir_one(int32_ty));
+    REQUIRE(!scope_contains(&scope, global));
+    REQUIRE(is_same_as_new_scope(&scope));
+
+    // Blocks that only depend on each other must leave the scope together.
+    struct fir_node* first = fir_cont(int32_ty);
+    struct fir_node* second = fir_cont(int32_ty);
+    set_op(&scope, second, fir_call(NULL, first, fir_param(second)));
+    set_op(&scope, first, fir_call(NULL, second, x));
+    REQUIRE(scope_contains(&scope, first));
+    REQUIRE(scope_contains(&scope, second));
+    REQUIRE(is_same_as_new_scope(&scope));
+    set_op(&scope, first, fir_call(NULL, second, fir_zero(int32_ty)));
+    REQUIRE(!scope_contains(&scope, first));
+    REQUIRE(!scope_contains(&scope, second));
+    REQUIRE(is_same_as_new_scope(&scope));
+
+    // Replacing the body of the function itself adds the new nodes that depend on its parameter.
+    set_op(&scope, func, fir_tup(mod, NULL,
+        (const struct fir_node*[]) { fir_node_mem_param(func), fir_iarith_op(FIR_IMUL, NULL, x, x) }, 2));
+    REQUIRE(is_same_as_new_scope(&scope));
+
+    scope_destroy(&scope);
+    fir_mod_destroy(mod);
+}
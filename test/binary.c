@@ -0,0 +1,199 @@
+#include "build.h"
+
+#include <overture/test.h>
+#include <overture/mem_stream.h>
+
+#include <fir/module.h>
+#include <fir/node.h>
+#include <fir/dbg_info.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static char* write_binary(const struct fir_mod* mod, size_t* size) {
+    struct mem_stream mem_stream;
+    mem_stream_init(&mem_stream);
+    bool status = fir_mod_write_binary(mem_stream.file, mod);
+    mem_stream_destroy(&mem_stream);
+    *size = status ? mem_stream.size : 0;
+    return mem_stream.buf;
+}
+
+TEST(binary_round_trip) {
+    struct fir_dbg_info_pool* dbg_pool = fir_dbg_info_pool_create();
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node* pow = build_rec_pow(mod);
+    fir_node_set_dbg_info(pow, fir_dbg_info(dbg_pool, "pow", "pow.c", (struct fir_source_range) {
+        .begin = { .row = 1, .col = 1, .bytes = 0 },
+        .end   = { .row = 3, .col = 2, .bytes = 40 }
+    }));
+    fir_node_make_external(pow);
+    const struct fir_node* float64_ty = fir_float_ty(mod, 64);
+    struct fir_node* global = fir_global(mod);
+    fir_node_set_op(global, 0, fir_array(NULL, fir_array_ty(float64_ty, 2), (const struct fir_node*[]) {
+        fir_float_const(float64_ty, 0.5), fir_float_const(float64_ty, -1.0e300)
+    }));
+    fir_node_make_external(global);
+
+    size_t size = 0;
+    char* data = write_binary(mod, &size);
+    REQUIRE(size > 0);
+
+    struct fir_mod* other_mod = fir_mod_create("other");
+    REQUIRE(fir_mod_read_binary(other_mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = data,
+        .data_size = size,
+        .error_log = stderr,
+        .dbg_pool = dbg_pool
+    }));
+    REQUIRE(!strcmp(fir_mod_name(other_mod), "module"));
+    REQUIRE(fir_mod_func_count(other_mod) == fir_mod_func_count(mod));
+    REQUIRE(fir_mod_global_count(other_mod) == 1);
+
+    struct fir_node* other_pow = fir_mod_first_external(other_mod);
+    REQUIRE(other_pow->tag == FIR_FUNC);
+    REQUIRE(!strcmp(fir_node_name(other_pow), "pow"));
+    REQUIRE(!strcmp(other_pow->dbg_info->file_name, "pow.c"));
+    REQUIRE(other_pow->dbg_info->source_range.end.bytes == 40);
+    struct fir_node* other_global = fir_node_next_external(other_pow);
+    REQUIRE(other_global->tag == FIR_GLOBAL);
+    const struct fir_node* other_float64_ty = fir_float_ty(other_mod, 64);
+    REQUIRE(other_global->ops[0]->ops[1] == fir_float_const(other_float64_ty, -1.0e300));
+
+    // Writing the module that was read must produce the same data.
+    size_t other_size = 0;
+    char* other_data = write_binary(other_mod, &other_size);
+    REQUIRE(size == other_size);
+    REQUIRE(!memcmp(data, other_data, size));
+    free(other_data);
+
+    // Truncated data must be rejected.
+    struct fir_mod* truncated_mod = fir_mod_create("truncated");
+    REQUIRE(!fir_mod_read_binary(truncated_mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = data,
+        .data_size = size - 1
+    }));
+
+    free(data);
+    fir_mod_destroy(truncated_mod);
+    fir_mod_destroy(other_mod);
+    fir_mod_destroy(mod);
+    fir_dbg_info_pool_destroy(dbg_pool);
+}
+
+static bool read_bytes(const uint8_t* data, size_t size) {
+    struct fir_mod* mod = fir_mod_create("module");
+    bool status = fir_mod_read_binary(mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = data,
+        .data_size = size
+    });
+    fir_mod_destroy(mod);
+    return status;
+}
+
+TEST(binary_malformed) {
+    // Function type without operands.
+    const uint8_t func_ty_data[] = { 'F', 'I', 'R', 'B', 2, 0, 0, 0, 1, FIR_FUNC_TY, 0, 0, 0, 0 };
+    REQUIRE(!read_bytes(func_ty_data, sizeof(func_ty_data)));
+
+    // Global initialized with `iadd(const[1], const[1])`, where the type of the second constant is
+    // the 32-bit integer type (reference 2), or the 64-bit one once patched (reference 6).
+    uint8_t iadd_data[] = {
+        'F', 'I', 'R', 'B', 2, 0, 0, 0,
+        3, FIR_INT_TY, 0, 32, 0, FIR_INT_TY, 0, 64, 0, FIR_PTR_TY, 0, 0,
+        1, FIR_GLOBAL, 0, 10,
+        0,
+        18,
+        3, FIR_CONST, 0, 2, 1, 0, FIR_CONST, 0, 2, 1, 0, FIR_IADD, 0, 2, 2, 5, 9, 5
+    };
+    REQUIRE(read_bytes(iadd_data, sizeof(iadd_data)));
+    iadd_data[34] = 6;
+    REQUIRE(!read_bytes(iadd_data, sizeof(iadd_data)));
+
+    // Global initialized with `load(bot, bot)`, where the type of the load is `tup_ty(mem_ty, int_ty[32])`
+    // (reference 18), or `tup_ty(int_ty[32], int_ty[32])` once patched (reference 14).
+    uint8_t load_data[] = {
+        'F', 'I', 'R', 'B', 2, 0, 0, 0,
+        5, FIR_MEM_TY, 0, 0, FIR_PTR_TY, 0, 0, FIR_INT_TY, 0, 32, 0, FIR_TUP_TY, 0, 2, 10, 10, FIR_TUP_TY, 0, 2, 2, 10,
+        1, FIR_GLOBAL, 0, 6,
+        0,
+        17,
+        3, FIR_BOT, 0, 2, 0, FIR_BOT, 0, 6, 0, FIR_LOAD, 0, 18, 0, 2, 9, 5, 5
+    };
+    REQUIRE(read_bytes(load_data, sizeof(load_data)));
+    load_data[46] = 14;
+    REQUIRE(!read_bytes(load_data, sizeof(load_data)));
+}
+
+TEST(binary_lazy_load) {
+    struct fir_mod* mod = fir_mod_create("module");
+    struct fir_node* pow = build_rec_pow(mod);
+    struct fir_node* other_pow = build_rec_pow(mod);
+    fir_node_make_external(pow);
+    fir_node_make_external(other_pow);
+
+    size_t size = 0;
+    char* data = write_binary(mod, &size);
+    REQUIRE(size > 0);
+
+    struct fir_mod* lazy_mod = fir_mod_create("lazy");
+    REQUIRE(fir_mod_read_binary(lazy_mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = data,
+        .data_size = size,
+        .error_log = stderr,
+        .is_lazy = true
+    }));
+    size_t func_count = fir_mod_func_count(lazy_mod);
+    REQUIRE(func_count == fir_mod_func_count(mod));
+    REQUIRE(fir_mod_stats(lazy_mod).lazy_func_count == func_count);
+
+    struct fir_node* lazy_pow = fir_mod_first_external(lazy_mod);
+    struct fir_node* lazy_other_pow = fir_node_next_external(lazy_pow);
+    REQUIRE(fir_node_is_lazy(lazy_pow));
+    REQUIRE(fir_node_is_exported(lazy_pow));
+    REQUIRE(!fir_node_is_imported(lazy_pow));
+
+    // Accessing the body of a function materializes it, along with its continuations.
+    REQUIRE(FIR_FUNC_BODY(lazy_pow) && FIR_FUNC_BODY(lazy_pow)->tag == FIR_START);
+    REQUIRE(!fir_node_is_lazy(lazy_pow));
+    REQUIRE(fir_node_is_lazy(lazy_other_pow));
+    struct fir_mod_stats stats = fir_mod_stats(lazy_mod);
+    REQUIRE(stats.materialized_func_count == func_count / 2);
+    REQUIRE(stats.lazy_func_count == func_count / 2);
+
+    // Cleaning up must not remove the nodes that lazy functions refer to.
+    fir_mod_cleanup_types(lazy_mod);
+    fir_mod_compact_ids(lazy_mod);
+    fir_mod_materialize(lazy_mod);
+    REQUIRE(!fir_node_is_lazy(lazy_other_pow));
+    stats = fir_mod_stats(lazy_mod);
+    REQUIRE(stats.materialized_func_count == func_count);
+    REQUIRE(stats.lazy_func_count == 0);
+
+    size_t lazy_size = 0;
+    char* lazy_data = write_binary(lazy_mod, &lazy_size);
+    REQUIRE(size == lazy_size);
+    REQUIRE(!memcmp(data, lazy_data, size));
+
+    // Concurrent modules are always loaded eagerly, since materializing a function is not thread-safe.
+    struct fir_mod* concurrent_mod = fir_mod_create_concurrent("concurrent");
+    REQUIRE(fir_mod_read_binary(concurrent_mod, &(struct fir_binary_input) {
+        .file_name = "module.firb",
+        .data = data,
+        .data_size = size,
+        .error_log = stderr,
+        .is_lazy = true
+    }));
+    REQUIRE(fir_mod_stats(concurrent_mod).lazy_func_count == 0);
+    REQUIRE(!fir_node_is_lazy(fir_mod_first_external(concurrent_mod)));
+
+    free(lazy_data);
+    free(data);
+    fir_mod_destroy(concurrent_mod);
+    fir_mod_destroy(lazy_mod);
+    fir_mod_destroy(mod);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+struct fir_mod;
+struct fir_node;
+
+/// Builds a recursive integer power function.
+struct fir_node* build_rec_pow(struct fir_mod*);
+/// Builds an iterative integer power function, which uses local variables and a loop.
+struct fir_node* build_iter_pow(struct fir_mod*);
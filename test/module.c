@@ -2,6 +2,11 @@
 
 #include <fir/module.h>
 #include <fir/node.h>
+#include <fir/dbg_info.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 TEST(module) {
     struct fir_mod* mod = fir_mod_create("module");
@@ -54,3 +59,428 @@ TEST(uses) {
 
     fir_mod_destroy(mod);
 }
+
+TEST(op_uses) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    const struct fir_node* param = fir_param(func);
+    const struct fir_node* add = fir_iarith_op(FIR_IADD, NULL, param, param);
+
+    REQUIRE(fir_use_count(param->uses) == 2);
+    REQUIRE(fir_use_find(param->uses, add, 0) != NULL);
+    REQUIRE(fir_use_find(param->uses, add, 1) != NULL);
+    REQUIRE(fir_use_find(param->uses, add, 0) != fir_use_find(param->uses, add, 1));
+
+    fir_node_set_op(func, 0, add);
+    REQUIRE(add->uses && add->uses->user == func && !add->uses->next);
+
+    fir_mod_destroy(mod);
+}
+
+TEST(rewire_shared_op) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    const struct fir_node* func_ty = fir_func_ty(int32_ty, int32_ty);
+    const struct fir_node* zero = fir_zero(int32_ty);
+    const struct fir_node* one  = fir_one(int32_ty);
+
+    // Every round moves all the users from one constant to the other, and removes the uses in the
+    // opposite order from which they were recorded.
+    enum { USER_COUNT = 100000, REWIRE_COUNT = 1000000 };
+    struct fir_node** users = malloc(sizeof(struct fir_node*) * USER_COUNT);
+    for (size_t i = 0; i < USER_COUNT; ++i) {
+        users[i] = fir_func(func_ty);
+        fir_node_set_op(users[i], 0, zero);
+    }
+    for (size_t i = 0; i < REWIRE_COUNT; ++i)
+        fir_node_set_op(users[i % USER_COUNT], 0, (i / USER_COUNT) % 2 == 0 ? one : zero);
+
+    REQUIRE(fir_use_count(zero->uses) == USER_COUNT);
+    REQUIRE(one->uses == NULL);
+    for (size_t i = 0; i < USER_COUNT; ++i)
+        fir_node_set_op(users[i], 0, NULL);
+    REQUIRE(zero->uses == NULL);
+
+    free(users);
+    fir_mod_destroy(mod);
+}
+
+TEST(externals) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    struct fir_node* global = fir_global(mod);
+    struct fir_node* import = fir_func(fir_func_ty(int32_ty, int32_ty));
+    REQUIRE(!fir_node_is_external(func));
+    REQUIRE(fir_mod_first_external(mod) == NULL);
+
+    fir_node_make_external(func);
+    fir_node_make_external(global);
+    fir_node_make_external(import);
+    REQUIRE(fir_node_is_external(func));
+    REQUIRE(fir_mod_first_external(mod) == func);
+    REQUIRE(fir_node_next_external(func) == global);
+    REQUIRE(fir_node_next_external(global) == import);
+    REQUIRE(fir_node_next_external(import) == NULL);
+
+    fir_node_make_internal(global);
+    REQUIRE(!fir_node_is_external(global));
+    REQUIRE(fir_node_next_external(func) == import);
+
+    // Imported nodes that are not used are removed from the list of externals when cleaning up.
+    fir_node_set_op(func, 0, fir_param(func));
+    fir_mod_cleanup(mod);
+    REQUIRE(fir_mod_first_external(mod) == func);
+    REQUIRE(fir_node_next_external(func) == NULL);
+
+    fir_mod_destroy(mod);
+}
+
+TEST(compact_ids) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    for (uint32_t i = 0; i < 100; ++i)
+        fir_int_const(int32_ty, i);
+    const struct fir_node* forty_two = fir_int_const(int32_ty, 42);
+    const struct fir_node* add = fir_iarith_op(FIR_IADD, NULL, fir_param(func), forty_two);
+    fir_node_set_op(func, 0, add);
+    fir_node_make_external(func);
+
+    fir_mod_cleanup(mod);
+    fir_mod_compact_ids(mod);
+
+    struct fir_mem_stats mem_stats = fir_mod_mem_stats(mod);
+    REQUIRE(func->id < mem_stats.node_count);
+    REQUIRE(add->id < mem_stats.node_count);
+    REQUIRE(forty_two->id < add->id);
+    REQUIRE(fir_int_const(int32_ty, 42) == forty_two);
+    REQUIRE(fir_iarith_op(FIR_IADD, NULL, fir_param(func), forty_two) == add);
+
+    fir_mod_destroy(mod);
+}
+
+TEST(cleanup_incremental) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    const struct fir_node* func_ty = fir_func_ty(int32_ty, int32_ty);
+    struct fir_node* func = fir_func(func_ty);
+    struct fir_node* callee = fir_func(func_ty);
+    fir_node_set_op(callee, 0, fir_iarith_op(FIR_IADD, NULL, fir_param(callee), fir_int_const(int32_ty, 1)));
+    fir_node_set_op(func, 0, fir_call(NULL, callee, fir_param(func)));
+    fir_node_make_external(func);
+    fir_mod_cleanup(mod);
+    REQUIRE(fir_mod_func_count(mod) == 2);
+
+    // Nodes that are no longer used after the function is rewired must be collected, including the
+    // callee that is only reachable from the old body.
+    fir_node_set_op(func, 0, fir_iarith_op(FIR_IMUL, NULL, fir_param(func), fir_int_const(int32_ty, 2)));
+    fir_mod_cleanup_incremental(mod);
+    REQUIRE(fir_mod_func_count(mod) == 1);
+    REQUIRE(fir_mod_funcs(mod)[0] == func);
+    REQUIRE(fir_param(func)->uses && !fir_param(func)->uses->next);
+
+    size_t node_count = fir_mod_mem_stats(mod).node_count;
+    fir_mod_cleanup(mod);
+    REQUIRE(fir_mod_mem_stats(mod).node_count == node_count);
+
+    // Cleaning up resets the dirty flag, so that nodes are recorded again when they become dirty.
+    REQUIRE(!func->is_dirty && !fir_param(func)->is_dirty);
+
+    // Making a function internal is enough to kill it.
+    fir_node_make_internal(func);
+    REQUIRE(func->is_dirty);
+    fir_mod_cleanup_incremental(mod);
+    REQUIRE(fir_mod_func_count(mod) == 0);
+
+    fir_mod_destroy(mod);
+}
+
+TEST(cleanup_types) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    fir_node_set_op(func, 0, fir_param(func));
+    fir_node_make_external(func);
+    for (uint32_t i = 1; i < 32; ++i)
+        fir_int_const(fir_int_ty(mod, i), i);
+    const struct fir_node* bool_ty = fir_bool_ty(mod);
+    const struct fir_node* unit = fir_unit(mod);
+
+    // Constants are reclaimed by a regular clean up, but types are not.
+    fir_mod_cleanup(mod);
+    struct fir_reclaim_stats stats = fir_mod_reclaim_stats(mod);
+    REQUIRE(stats.const_count == 31);
+    REQUIRE(stats.type_count == 0);
+
+    fir_mod_cleanup_types(mod);
+    stats = fir_mod_reclaim_stats(mod);
+    REQUIRE(stats.type_count == 30);
+    REQUIRE(stats.type_bytes > 0);
+    REQUIRE(stats.node_count == stats.type_count + stats.const_count);
+    REQUIRE(fir_int_ty(mod, 32) == int32_ty);
+    REQUIRE(fir_bool_ty(mod) == bool_ty);
+    REQUIRE(fir_unit(mod) == unit);
+    REQUIRE(fir_int_ty(mod, 7)->data.bitwidth == 7);
+
+    fir_mod_destroy(mod);
+}
+
+TEST(mod_stats) {
+    struct fir_mod* mod = fir_mod_create("module");
+
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    const struct fir_node* add = fir_iarith_op(FIR_IADD, NULL, fir_param(func), fir_int_const(int32_ty, 1));
+    fir_node_set_op(func, 0, add);
+    fir_node_make_external(func);
+
+    // Building the same node again only finds existing nodes.
+    REQUIRE(fir_iarith_op(FIR_IADD, NULL, fir_param(func), fir_int_const(int32_ty, 1)) == add);
+
+    struct fir_mod_stats stats = fir_mod_stats(mod);
+    REQUIRE(stats.func_count == 1);
+    REQUIRE(stats.tag_counts[FIR_FUNC] == 1);
+    REQUIRE(stats.tag_counts[FIR_IADD] == 1);
+    REQUIRE(stats.hash_cons.hit_count >= 3);
+    REQUIRE(stats.hit_rate > 0 && stats.hit_rate < 1);
+
+    size_t node_count = 0;
+    for (size_t i = 0; i < FIR_NODE_TAG_COUNT; ++i)
+        node_count += stats.tag_counts[i];
+    REQUIRE(node_count == stats.mem.node_count);
+
+    size_t probed_node_count = 0;
+    for (size_t i = 0; i < FIR_PROBE_HISTOGRAM_SIZE; ++i)
+        probed_node_count += stats.probe_histogram[i];
+    REQUIRE(probed_node_count == stats.table_node_count);
+    REQUIRE(stats.table_node_count + stats.func_count == stats.mem.node_count);
+
+    // Removing the addition puts it on the free lists.
+    fir_node_set_op(func, 0, fir_param(func));
+    fir_mod_cleanup(mod);
+    stats = fir_mod_stats(mod);
+    REQUIRE(stats.tag_counts[FIR_IADD] == 0);
+    REQUIRE(stats.free_node_count >= 1);
+
+    fir_mod_destroy(mod);
+}
+
+#define CONCURRENT_THREAD_COUNT 4
+#define CONCURRENT_CONST_COUNT 1000
+
+static void* build_consts(void* data) {
+    struct fir_mod* mod = data;
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    const struct fir_node* sum = fir_param(func);
+    for (uint32_t i = 1; i <= CONCURRENT_CONST_COUNT; ++i)
+        sum = fir_iarith_op(FIR_IADD, NULL, sum, fir_int_const(int32_ty, i));
+    fir_node_set_op(func, 0, sum);
+    fir_node_make_external(func);
+    return NULL;
+}
+
+TEST(concurrent_module) {
+    struct fir_mod* mod = fir_mod_create_concurrent("module");
+    REQUIRE(fir_mod_is_concurrent(mod));
+
+    pthread_t threads[CONCURRENT_THREAD_COUNT];
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; ++i)
+        pthread_create(&threads[i], NULL, build_consts, mod);
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; ++i)
+        pthread_join(threads[i], NULL);
+
+    // Constants are shared by all threads, and must have been created only once.
+    struct fir_mod_stats stats = fir_mod_stats(mod);
+    REQUIRE(stats.func_count == CONCURRENT_THREAD_COUNT);
+    REQUIRE(stats.tag_counts[FIR_CONST] == CONCURRENT_CONST_COUNT);
+    REQUIRE(stats.tag_counts[FIR_IADD] == CONCURRENT_THREAD_COUNT * CONCURRENT_CONST_COUNT);
+    const struct fir_node* one = fir_int_const(fir_int_ty(mod, 32), 1);
+    size_t use_count = 0;
+    for (const struct fir_use* use = one->uses; use; use = use->next)
+        use_count++;
+    REQUIRE(use_count == CONCURRENT_THREAD_COUNT);
+
+    fir_mod_cleanup(mod);
+    REQUIRE(fir_mod_func_count(mod) == CONCURRENT_THREAD_COUNT);
+
+    fir_mod_destroy(mod);
+}
+
+static void* build_and_commit_consts(void* data) {
+    struct fir_mod_builder* builder = fir_mod_builder_create(data);
+    build_consts(fir_mod_builder_mod(builder));
+    fir_mod_builder_commit(builder);
+    fir_mod_builder_destroy(builder);
+    return NULL;
+}
+
+TEST(mod_builder) {
+    struct fir_mod* mod = fir_mod_create_concurrent("module");
+
+    pthread_t threads[CONCURRENT_THREAD_COUNT];
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; ++i)
+        pthread_create(&threads[i], NULL, build_and_commit_consts, mod);
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; ++i)
+        pthread_join(threads[i], NULL);
+
+    // Builders have their own hash-consing tables, but committed nodes must be deduplicated.
+    struct fir_mod_stats stats = fir_mod_stats(mod);
+    REQUIRE(stats.func_count == CONCURRENT_THREAD_COUNT);
+    REQUIRE(stats.tag_counts[FIR_CONST] == CONCURRENT_CONST_COUNT);
+    REQUIRE(stats.tag_counts[FIR_IADD] == CONCURRENT_THREAD_COUNT * CONCURRENT_CONST_COUNT);
+    size_t external_count = 0;
+    for (struct fir_node* external = fir_mod_first_external(mod); external; external = fir_node_next_external(external))
+        external_count++;
+    REQUIRE(external_count == CONCURRENT_THREAD_COUNT);
+
+    // Recursive functions must point to their committed counterpart.
+    struct fir_mod_builder* builder = fir_mod_builder_create(mod);
+    struct fir_mod* private_mod = fir_mod_builder_mod(builder);
+    const struct fir_node* int32_ty = fir_int_ty(private_mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(int32_ty, int32_ty));
+    fir_node_set_op(func, 0, fir_call(NULL, func, fir_param(func)));
+    fir_mod_builder_commit(builder);
+
+    const struct fir_node* committed_func = fir_mod_builder_find(builder, func);
+    REQUIRE(committed_func);
+    REQUIRE(fir_node_mod(committed_func) == mod);
+    REQUIRE(committed_func->ops[0]->tag == FIR_CALL);
+    REQUIRE(committed_func->ops[0]->ops[0] == committed_func);
+    REQUIRE(committed_func->ty->ops[0] == fir_int_ty(mod, 32));
+    REQUIRE(fir_mod_func_count(mod) == CONCURRENT_THREAD_COUNT + 1);
+
+    // Committing again must not duplicate nominal nodes.
+    fir_mod_builder_commit(builder);
+    REQUIRE(fir_mod_func_count(mod) == CONCURRENT_THREAD_COUNT + 1);
+    fir_mod_builder_destroy(builder);
+
+    fir_mod_destroy(mod);
+}
+
+static struct fir_node* external_func(
+    struct fir_mod* mod,
+    struct fir_dbg_info_pool* dbg_pool,
+    const char* name,
+    const struct fir_node* param_ty)
+{
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* func = fir_func(fir_func_ty(param_ty ? param_ty : int32_ty, int32_ty));
+    fir_node_set_dbg_info(func, fir_dbg_info(dbg_pool, name, "", (struct fir_source_range) {}));
+    fir_node_make_external(func);
+    return func;
+}
+
+TEST(link) {
+    struct fir_dbg_info_pool* dbg_pool = fir_dbg_info_pool_create();
+
+    // The first module defines `f` and uses `g`, the second one defines `g` and uses `f`.
+    struct fir_mod* mod1 = fir_mod_create("mod1");
+    struct fir_node* f = external_func(mod1, dbg_pool, "f", NULL);
+    struct fir_node* g_decl = external_func(mod1, dbg_pool, "g", NULL);
+    fir_node_set_op(f, 0, fir_call(NULL, g_decl, fir_param(f)));
+
+    struct fir_mod* mod2 = fir_mod_create("mod2");
+    struct fir_node* g = external_func(mod2, dbg_pool, "g", NULL);
+    struct fir_node* f_decl = external_func(mod2, dbg_pool, "f", NULL);
+    fir_node_set_op(g, 0, fir_call(NULL, f_decl, fir_param(g)));
+
+    struct fir_mod* mod = fir_mod_create("module");
+    REQUIRE(fir_mod_link(mod, mod1, NULL));
+    REQUIRE(fir_mod_link(mod, mod2, NULL));
+    REQUIRE(fir_mod_func_count(mod) == 2);
+
+    struct fir_node* linked_f = fir_mod_first_external(mod);
+    struct fir_node* linked_g = fir_node_next_external(linked_f);
+    REQUIRE(!strcmp(fir_node_name(linked_f), "f"));
+    REQUIRE(!strcmp(fir_node_name(linked_g), "g"));
+    REQUIRE(fir_node_is_exported(linked_f));
+    REQUIRE(fir_node_is_exported(linked_g));
+    REQUIRE(linked_f->ops[0]->ops[0] == linked_g);
+    REQUIRE(linked_g->ops[0]->ops[0] == linked_f);
+    REQUIRE(linked_f->ty == linked_g->ty);
+
+    // Defining `f` again, or declaring it with another type, is a conflict.
+    struct fir_mod* mod3 = fir_mod_create("mod3");
+    struct fir_node* other_f = external_func(mod3, dbg_pool, "f", NULL);
+    fir_node_set_op(other_f, 0, fir_param(other_f));
+    struct fir_mod* mod4 = fir_mod_create("mod4");
+    external_func(mod4, dbg_pool, "f", fir_int_ty(mod4, 64));
+    REQUIRE(!fir_mod_link_all(mod, (const struct fir_mod*[]) { mod3, mod4 }, 2, NULL));
+    REQUIRE(fir_mod_func_count(mod) == 2);
+
+    fir_mod_destroy(mod);
+    fir_mod_destroy(mod1);
+    fir_mod_destroy(mod2);
+    fir_mod_destroy(mod3);
+    fir_mod_destroy(mod4);
+    fir_dbg_info_pool_destroy(dbg_pool);
+}
+
+TEST(checkpoint) {
+    struct fir_mod* mod = fir_mod_create("module");
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    struct fir_node* f = fir_func(fir_func_ty(int32_ty, int32_ty));
+    struct fir_node* g = fir_func(fir_func_ty(int32_ty, int32_ty));
+    const struct fir_node* f_body = fir_iarith_op(FIR_IADD, NULL, fir_param(f), fir_one(int32_ty));
+    fir_node_set_op(f, 0, f_body);
+    fir_node_make_external(f);
+    fir_node_make_external(g);
+    struct fir_mem_stats mem_stats = fir_mod_mem_stats(mod);
+    struct fir_reclaim_stats reclaim_stats = fir_mod_reclaim_stats(mod);
+
+    // Changes made since a checkpoint are undone when rolling back, including new types.
+    fir_mod_checkpoint(mod);
+    const struct fir_node* int64_ty = fir_int_ty(mod, 64);
+    struct fir_node* h = fir_func(fir_func_ty(int64_ty, int32_ty));
+    fir_node_set_op(h, 0, fir_call(NULL, f, fir_int_const(int32_ty, 42)));
+    fir_node_set_op(f, 0, fir_call(NULL, h, fir_zero(int64_ty)));
+    fir_node_make_internal(f);
+    fir_node_make_external(h);
+    fir_mod_rollback(mod);
+
+    REQUIRE(f->ops[0] == f_body);
+    REQUIRE(fir_mod_func_count(mod) == 2);
+    REQUIRE(fir_mod_first_external(mod) == f);
+    REQUIRE(fir_node_next_external(f) == g);
+    REQUIRE(!fir_node_next_external(g));
+    REQUIRE(f_body->uses && !f_body->uses->next);
+    struct fir_mem_stats rolled_back_mem_stats = fir_mod_mem_stats(mod);
+    REQUIRE(rolled_back_mem_stats.node_count == mem_stats.node_count);
+    REQUIRE(rolled_back_mem_stats.use_bytes == mem_stats.use_bytes);
+
+    // Nodes freed by a rollback are not counted as reclaimed by a cleanup.
+    struct fir_reclaim_stats rolled_back_reclaim_stats = fir_mod_reclaim_stats(mod);
+    REQUIRE(!memcmp(&rolled_back_reclaim_stats, &reclaim_stats, sizeof(struct fir_reclaim_stats)));
+
+    // Nested checkpoints that are committed are still undone by the enclosing checkpoint.
+    fir_mod_checkpoint(mod);
+    fir_node_set_op(g, 0, fir_param(g));
+    fir_mod_checkpoint(mod);
+    fir_node_set_op(f, 0, fir_param(f));
+    fir_mod_commit(mod);
+    REQUIRE(f->ops[0] == fir_param(f));
+    fir_mod_rollback(mod);
+    REQUIRE(f->ops[0] == f_body);
+    REQUIRE(!g->ops[0]);
+
+    fir_mod_checkpoint(mod);
+    fir_node_set_op(g, 0, fir_param(g));
+    fir_mod_commit(mod);
+    REQUIRE(g->ops[0] == fir_param(g));
+
+    fir_mod_cleanup_incremental(mod);
+    fir_mod_cleanup(mod);
+    REQUIRE(fir_mod_func_count(mod) == 2);
+    REQUIRE(f->ops[0] == f_body);
+
+    fir_mod_destroy(mod);
+}
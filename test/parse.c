@@ -201,3 +201,78 @@ TEST(parse_ctrl) {
 
     fir_mod_destroy(mod);
 }
+
+TEST(parse_stream) {
+    // Generate a file that is larger than the buffer used when parsing from a stream, with forward
+    // references in every function.
+    FILE* file = tmpfile();
+    REQUIRE(file);
+    const size_t func_count = 2000;
+    for (size_t i = 0; i < func_count; ++i) {
+        fprintf(file,
+            "func_ty(int_ty[32], int_ty[32]) f%zu = func(res%zu)\n"
+            "int_ty[32] x%zu = param(f%zu)\n"
+            "int_ty[32] c%zu = const[%zu]\n"
+            "int_ty[32] res%zu = iadd(x%zu, c%zu)\n",
+            i, i, i, i, i, i, i, i, i);
+    }
+    REQUIRE(ftell(file) > 65536);
+    rewind(file);
+
+    struct fir_mod* mod = fir_mod_create("module");
+    bool status = fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "stream",
+        .file_stream = file,
+        .error_log = stderr
+    });
+    fclose(file);
+    REQUIRE(status);
+
+    struct fir_node* const* funcs = fir_mod_funcs(mod);
+    REQUIRE(fir_mod_func_count(mod) == func_count);
+    const struct fir_node* int32_ty = fir_int_ty(mod, 32);
+    for (size_t i = 0; i < func_count; ++i) {
+        const struct fir_node* res = fir_iarith_op(FIR_IADD, NULL, fir_param(funcs[i]), fir_int_const(int32_ty, i));
+        REQUIRE(FIR_FUNC_BODY(funcs[i]) == res);
+    }
+    fir_mod_destroy(mod);
+}
+
+TEST(parse_forward_ref) {
+    const char data[] =
+        "func_ty(int_ty[32], int_ty[32]) f = func(int_ty[32] iadd(x, one))\n"
+        "func_ty(int_ty[32], int_ty[32]) g = func(y)\n"
+        "int_ty[32] x = param(f)\n"
+        "int_ty[32] one = const[1]\n"
+        "int_ty[32] y = param(g)\n";
+
+    struct fir_mod* mod = fir_mod_create("module");
+    REQUIRE(fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "stdin",
+        .file_data = data,
+        .file_size = strlen(data),
+        .error_log = stderr
+    }));
+    struct fir_node* const* funcs = fir_mod_funcs(mod);
+    REQUIRE(fir_mod_func_count(mod) == 2);
+
+    const struct fir_node* one = fir_int_const(fir_int_ty(mod, 32), 1);
+    REQUIRE(FIR_FUNC_BODY(funcs[0]) == fir_iarith_op(FIR_IADD, NULL, fir_param(funcs[0]), one));
+    REQUIRE(FIR_FUNC_BODY(funcs[1]) == fir_param(funcs[1]));
+    fir_mod_destroy(mod);
+}
+
+TEST(parse_unknown_forward_ref) {
+    const char data[] =
+        "func_ty(int_ty[32], int_ty[32]) f = func(x)\n"
+        "func_ty(int_ty[32], int_ty[32]) g = func(int_ty[32] iadd(y, y))\n";
+
+    struct fir_mod* mod = fir_mod_create("module");
+    REQUIRE(!fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "stdin",
+        .file_data = data,
+        .file_size = strlen(data),
+        .error_log = NULL // silence errors
+    }));
+    fir_mod_destroy(mod);
+}
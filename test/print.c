@@ -0,0 +1,158 @@
+#include "build.h"
+
+#include <overture/test.h>
+#include <overture/mem_stream.h>
+
+#include <fir/module.h>
+#include <fir/node.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+TEST(print_to_string) {
+    const char data[] =
+        "func_ty(int_ty[32], int_ty[32]) f = func(res)\n"
+        "func_ty(tup_ty(frame_ty, func_ty(int_ty[32], noret_ty)), noret_ty) entry = func(exit)\n"
+        "tup_ty(frame_ty, func_ty(int_ty[32], noret_ty)) entry_param = param(entry)\n"
+        "ctrl_ty entry_ctrl = ctrl(entry)\n"
+        "int_ty[32] x = param(f)\n"
+        "float_ty[64] half = const[0x1p-1]\n"
+        "func_ty(int_ty[32], noret_ty) ret = ext(entry_param, int_ty[32] const[1])\n"
+        "int_ty[32] x_plus_one = iadd(x, int_ty[32] const[4294967295])@entry_ctrl\n"
+        "noret_ty exit = call(ret, x_plus_one)@entry_ctrl\n"
+        "int_ty[32] res = start(entry)\n"
+        "func_ty(int_ty[64], int_ty[64]) g = func(g_res)\n"
+        "func_ty(tup_ty(frame_ty, func_ty(int_ty[64], noret_ty)), noret_ty) g_entry = func(g_exit)\n"
+        "tup_ty(frame_ty, func_ty(int_ty[64], noret_ty)) g_entry_param = param(g_entry)\n"
+        "ctrl_ty g_entry_ctrl = ctrl(g_entry)\n"
+        "int_ty[64] z = param(g)\n"
+        "func_ty(int_ty[64], noret_ty) g_ret = ext(g_entry_param, int_ty[32] const[1])\n"
+        "int_ty[64] y = imul(z, z)@g_entry_ctrl\n"
+        "noret_ty g_exit = call(g_ret, y)@g_entry_ctrl\n"
+        "int_ty[64] g_res = start(g_entry)\n";
+
+    struct fir_mod* mod = fir_mod_create("module");
+    REQUIRE(fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "stdin",
+        .file_data = data,
+        .file_size = strlen(data),
+        .error_log = stderr
+    }));
+
+    // Printing to a string must produce the same text as printing to a file.
+    struct fir_mod_print_options print_options = {
+        .tab = "    ",
+        .verbosity = FIR_VERBOSITY_HIGH,
+        .disable_colors = true
+    };
+    struct mem_stream mem_stream;
+    mem_stream_init(&mem_stream);
+    fir_mod_print(mem_stream.file, mod, &print_options);
+    mem_stream_flush(&mem_stream);
+    char* printed_data = fir_mod_print_to_string(mod, &print_options);
+    bool is_same = strlen(printed_data) == mem_stream.size && !memcmp(printed_data, mem_stream.buf, mem_stream.size);
+    free(printed_data);
+
+    // Printing functions in parallel must not change the output either.
+    print_options.thread_count = 4;
+    printed_data = fir_mod_print_to_string(mod, &print_options);
+    is_same &= strlen(printed_data) == mem_stream.size && !memcmp(printed_data, mem_stream.buf, mem_stream.size);
+    free(printed_data);
+    mem_stream_destroy(&mem_stream);
+    free(mem_stream.buf);
+    fir_mod_destroy(mod);
+    REQUIRE(is_same);
+}
+
+TEST(print_in_parallel) {
+    // Analysing functions from several threads looks up nodes in the module, so functions are only
+    // printed in parallel in concurrent modules. The output must be the same in both cases.
+    struct fir_mod* mods[] = { fir_mod_create("module"), fir_mod_create_concurrent("module") };
+    bool is_same = true;
+    for (size_t i = 0; i < sizeof(mods) / sizeof(mods[0]); ++i) {
+        for (size_t j = 0; j < 256; ++j)
+            fir_node_make_external(build_rec_pow(mods[i]));
+        fir_mod_cleanup(mods[i]);
+
+        struct fir_mod_print_options print_options = {
+            .tab = "    ",
+            .verbosity = FIR_VERBOSITY_HIGH,
+            .disable_colors = true
+        };
+        char* sequential_data = fir_mod_print_to_string(mods[i], &print_options);
+        print_options.thread_count = 8;
+        char* parallel_data = fir_mod_print_to_string(mods[i], &print_options);
+        is_same &= !strcmp(sequential_data, parallel_data);
+        free(sequential_data);
+        free(parallel_data);
+        fir_mod_destroy(mods[i]);
+    }
+    REQUIRE(is_same);
+}
+
+TEST(print_lazy_in_parallel) {
+    // Functions that do not use their parameter are stored without it, which is then created again
+    // when they are analysed.
+    FILE* file = tmpfile();
+    REQUIRE(file);
+    for (size_t i = 0; i < 64; ++i) {
+        fprintf(file,
+            "func_ty(int_ty[32], int_ty[32]) f%zu = extern func(res%zu)\n"
+            "func_ty(tup_ty(frame_ty, func_ty(int_ty[32], noret_ty)), noret_ty) entry%zu = func(exit%zu)\n"
+            "tup_ty(frame_ty, func_ty(int_ty[32], noret_ty)) entry_param%zu = param(entry%zu)\n"
+            "ctrl_ty entry_ctrl%zu = ctrl(entry%zu)\n"
+            "func_ty(int_ty[32], noret_ty) ret%zu = ext(entry_param%zu, int_ty[32] const[1])\n"
+            "noret_ty exit%zu = call(ret%zu, int_ty[32] const[%zu])@entry_ctrl%zu\n"
+            "int_ty[32] res%zu = start(entry%zu)\n",
+            i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i);
+    }
+    rewind(file);
+
+    struct fir_mod* mod = fir_mod_create("module");
+    bool status = fir_mod_parse(mod, &(struct fir_parse_input) {
+        .file_name = "stream",
+        .file_stream = file,
+        .error_log = stderr
+    });
+    fclose(file);
+    REQUIRE(status);
+    for (size_t i = 0; i < 64; ++i) {
+        fir_node_make_external(build_rec_pow(mod));
+        fir_node_make_external(build_iter_pow(mod));
+    }
+    struct mem_stream mem_stream;
+    mem_stream_init(&mem_stream);
+    REQUIRE(fir_mod_write_binary(mem_stream.file, mod));
+    mem_stream_destroy(&mem_stream);
+    fir_mod_destroy(mod);
+
+    // Printing materializes lazy functions, which must give their nodes the same IDs as when
+    // printing sequentially.
+    struct fir_mod* (*create_mods[])(const char*) = { fir_mod_create, fir_mod_create_concurrent };
+    bool is_same = true;
+    for (size_t i = 0; i < sizeof(create_mods) / sizeof(create_mods[0]); ++i) {
+        char* printed_data[2];
+        for (size_t j = 0; j < 2; ++j) {
+            struct fir_mod* lazy_mod = create_mods[i]("lazy");
+            REQUIRE(fir_mod_read_binary(lazy_mod, &(struct fir_binary_input) {
+                .file_name = "module.firb",
+                .data = mem_stream.buf,
+                .data_size = mem_stream.size,
+                .error_log = stderr,
+                .is_lazy = true
+            }));
+            printed_data[j] = fir_mod_print_to_string(lazy_mod, &(struct fir_mod_print_options) {
+                .tab = "    ",
+                .verbosity = FIR_VERBOSITY_HIGH,
+                .disable_colors = true,
+                .thread_count = j == 0 ? 1 : 8
+            });
+            fir_mod_destroy(lazy_mod);
+        }
+        is_same &= !strcmp(printed_data[0], printed_data[1]);
+        free(printed_data[0]);
+        free(printed_data[1]);
+    }
+    free(mem_stream.buf);
+    REQUIRE(is_same);
+}
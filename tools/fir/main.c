@@ -1,28 +1,37 @@
 #include <fir/module.h>
 #include <fir/version.h>
 #include <fir/codegen.h>
+#include <fir/node.h>
 
 #include <overture/term.h>
 #include <overture/cli.h>
-#include <overture/file.h>
 #include <overture/str.h>
+#include <overture/mem_stream.h>
 
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
 
 static enum cli_state usage(void*, char*) {
     printf(
-        "usage: fir [options] file.fir ...\n"
+        "usage: fir [options] file.fir|file.firb ...\n"
         "options:\n"
         "  -h  --help               Shows this message.\n"
         "      --version            Shows version information.\n"
         "  -v  --verbose            Makes the output verbose.\n"
         "      --no-color           Disables colors in the output.\n"
         "      --no-cleanup         Do not clean up the module after loading it.\n"
-        "      --codegen <name>     Selects the given code generator.\n");
+        "      --stats              Prints memory and hash-consing statistics about the module.\n"
+        "      --emit-bin <file>    Writes the module in binary form to the given file (only with a\n"
+        "                           single input file).\n"
+        "      --codegen <name>     Selects the given code generator.\n"
+        "  -j  --jobs <n>           Processes up to the given number of files in parallel, or prints\n"
+        "                           the functions of a single text file in parallel.\n");
     return CLI_STATE_ERROR;
 }
 
@@ -59,9 +68,13 @@ static enum cli_state version(void*, char*) {
 
 struct options {
     char* codegen;
+    char* binary_file;
     bool disable_cleanup;
     bool disable_colors;
     bool is_verbose;
+    bool print_stats;
+    uint32_t job_count;
+    uint32_t print_thread_count;
 };
 
 static enum fir_codegen_tag codegen_tag_from_string(const char* name) {
@@ -72,10 +85,10 @@ static enum fir_codegen_tag codegen_tag_from_string(const char* name) {
     return FIR_CODEGEN_DUMMY;
 }
 
-static inline bool generate_code(struct fir_mod* mod, const struct options* options) {
+static inline bool generate_code(struct fir_mod* mod, const struct options* options, FILE* err) {
     struct fir_codegen* codegen = fir_codegen_create(codegen_tag_from_string(options->codegen), NULL, 0);
     if (!codegen) {
-        fprintf(stderr, "code generator '%s' is not supported\n", options->codegen);
+        fprintf(err, "code generator '%s' is not supported\n", options->codegen);
         return false;
     }
 
@@ -87,63 +100,244 @@ static inline bool generate_code(struct fir_mod* mod, const struct options* opti
     return status;
 }
 
-static inline bool compile_file(const char* file_name, const struct options* options) {
-    size_t file_size = 0;
-    char* file_data = file_read(file_name, &file_size);
-    if (!file_data) {
-        fprintf(stderr, "cannot open file '%s'\n", file_name);
+static inline void print_stats(FILE* file, const struct fir_mod* mod) {
+    struct fir_mod_stats stats = fir_mod_stats(mod);
+    fprintf(file, "statistics for module '%s':\n", fir_mod_name(mod));
+    fprintf(file, "  nodes:       %zu (%zu bytes)\n", stats.mem.node_count, stats.mem.node_bytes);
+    fprintf(file, "  uses:        %zu bytes\n", stats.mem.use_bytes);
+    fprintf(file, "  free nodes:  %zu (%zu bytes)\n", stats.free_node_count, stats.free_node_bytes);
+    fprintf(file, "  node pool:   %zu bytes\n", stats.mem.pool_bytes);
+    fprintf(file, "  functions:   %zu (%zu materialized, %zu lazy)\n",
+        stats.func_count, stats.materialized_func_count, stats.lazy_func_count);
+    fprintf(file, "  globals:     %zu\n", stats.global_count);
+    fprintf(file, "  locals:      %zu\n", stats.local_count);
+    fprintf(file, "  table:       %zu/%zu slots (%zu bytes, load factor %.2f)\n",
+        stats.table_node_count, stats.table_capacity, stats.mem.table_bytes, stats.table_load_factor);
+    fprintf(file, "  lookups:     %zu hits, %zu misses (hit rate %.2f), %zu probes\n",
+        stats.hash_cons.hit_count, stats.hash_cons.miss_count, stats.hit_rate, stats.hash_cons.probe_count);
+    fprintf(file, "  probe lengths:\n");
+    for (size_t i = 0; i < FIR_PROBE_HISTOGRAM_SIZE; ++i) {
+        if (stats.probe_histogram[i] > 0) {
+            fprintf(file, "    %s%-10zu %zu\n",
+                i == FIR_PROBE_HISTOGRAM_SIZE - 1 ? ">=" : "  ", i + 1, stats.probe_histogram[i]);
+        }
+    }
+    fprintf(file, "  nodes per tag:\n");
+    for (size_t i = 0; i < FIR_NODE_TAG_COUNT; ++i) {
+        if (stats.tag_counts[i] > 0)
+            fprintf(file, "    %-12s %zu\n", fir_node_tag_to_string(i), stats.tag_counts[i]);
+    }
+}
+
+static inline bool is_binary_file(const char* file_name) {
+    size_t len = strlen(file_name);
+    return len >= 5 && !strcmp(file_name + len - 5, ".firb");
+}
+
+static inline bool load_file(struct fir_mod* mod, const char* file_name, FILE* err) {
+    if (is_binary_file(file_name))
+        return fir_mod_read_binary_file(mod, file_name, err, NULL, true);
+
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        fprintf(err, "cannot open file '%s'\n", file_name);
         return false;
     }
-    struct fir_mod* mod = fir_mod_create(file_name);
     bool status = fir_mod_parse(mod, &(struct fir_parse_input) {
         .file_name = file_name,
-        .file_data = file_data,
-        .file_size = file_size,
-        .error_log = stderr
+        .file_stream = file,
+        .error_log = err
     });
-    free(file_data);
-    if (!options->disable_cleanup)
+    fclose(file);
+    return status;
+}
+
+static inline bool write_binary_file(const struct fir_mod* mod, const char* file_name, FILE* err) {
+    FILE* file = fopen(file_name, "wb");
+    if (!file) {
+        fprintf(err, "cannot open file '%s'\n", file_name);
+        return false;
+    }
+    bool status = fir_mod_write_binary(file, mod);
+    status &= fclose(file) == 0;
+    if (!status)
+        fprintf(err, "cannot write file '%s'\n", file_name);
+    return status;
+}
+
+static inline bool compile_file(const char* file_name, const struct options* options, FILE* out, FILE* err) {
+    // Functions can only be printed in parallel if the module is safe to look up from several threads.
+    // Binary files are read lazily, which is not possible in concurrent modules, and loading them
+    // eagerly would change the IDs of their nodes, so they are always printed sequentially.
+    struct fir_mod* mod = options->print_thread_count > 1 && !is_binary_file(file_name)
+        ? fir_mod_create_concurrent(file_name) : fir_mod_create(file_name);
+    bool status = load_file(mod, file_name, err);
+    if (!options->disable_cleanup) {
         fir_mod_cleanup(mod);
+        fir_mod_compact_ids(mod);
+    }
 
     struct fir_mod_print_options print_options = {
         .tab = "    ",
         .verbosity = options->is_verbose ? FIR_VERBOSITY_HIGH : FIR_VERBOSITY_MEDIUM,
-        .disable_colors = options->disable_colors || !is_term(stdout)
+        .disable_colors = options->disable_colors,
+        .thread_count = options->print_thread_count
     };
-    fir_mod_print(stdout, mod, &print_options);
+    fir_mod_print(out, mod, &print_options);
+    if (options->print_stats)
+        print_stats(err, mod);
+    if (options->binary_file)
+        status &= write_binary_file(mod, options->binary_file, err);
 
-    status &= generate_code(mod, options);
+    status &= generate_code(mod, options, err);
 
     fir_mod_destroy(mod);
     return status;
 }
 
+// When files are processed in parallel, the output of each file is kept in memory until the output
+// of the files that come before it on the command line has been written.
+struct job {
+    const char* file_name;
+    struct mem_stream out;
+    struct mem_stream err;
+    bool status;
+    bool is_done;
+};
+
+struct job_queue {
+    struct job* jobs;
+    size_t job_count;
+    atomic_size_t next_job;
+    const struct options* options;
+    pthread_mutex_t mutex;
+    pthread_cond_t done_cond;
+};
+
+static void* run_jobs(void* data) {
+    struct job_queue* job_queue = data;
+    while (true) {
+        size_t job_index = atomic_fetch_add_explicit(&job_queue->next_job, 1, memory_order_relaxed);
+        if (job_index >= job_queue->job_count)
+            break;
+
+        struct job* job = &job_queue->jobs[job_index];
+        mem_stream_init(&job->out);
+        mem_stream_init(&job->err);
+        bool status = compile_file(job->file_name, job_queue->options, job->out.file, job->err.file);
+        mem_stream_destroy(&job->out);
+        mem_stream_destroy(&job->err);
+
+        pthread_mutex_lock(&job_queue->mutex);
+        job->status = status;
+        job->is_done = true;
+        pthread_cond_broadcast(&job_queue->done_cond);
+        pthread_mutex_unlock(&job_queue->mutex);
+    }
+    return NULL;
+}
+
+static bool compile_files_in_parallel(
+    const char* const* file_names,
+    size_t file_count,
+    const struct options* options)
+{
+    struct job_queue job_queue = {
+        .jobs = calloc(file_count, sizeof(struct job)),
+        .job_count = file_count,
+        .options = options
+    };
+    pthread_mutex_init(&job_queue.mutex, NULL);
+    pthread_cond_init(&job_queue.done_cond, NULL);
+    for (size_t i = 0; i < file_count; ++i)
+        job_queue.jobs[i].file_name = file_names[i];
+
+    size_t thread_count = options->job_count < file_count ? options->job_count : file_count;
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_create(&threads[i], NULL, run_jobs, &job_queue);
+
+    bool status = true;
+    for (size_t i = 0; i < file_count; ++i) {
+        struct job* job = &job_queue.jobs[i];
+        pthread_mutex_lock(&job_queue.mutex);
+        while (!job->is_done)
+            pthread_cond_wait(&job_queue.done_cond, &job_queue.mutex);
+        pthread_mutex_unlock(&job_queue.mutex);
+
+        fwrite(job->out.buf, 1, job->out.size, stdout);
+        fwrite(job->err.buf, 1, job->err.size, stderr);
+        fflush(stdout);
+        fflush(stderr);
+        free(job->out.buf);
+        free(job->err.buf);
+        status &= job->status;
+    }
+
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_cond_destroy(&job_queue.done_cond);
+    pthread_mutex_destroy(&job_queue.mutex);
+    free(job_queue.jobs);
+    return status;
+}
+
 int main(int argc, char** argv) {
-    struct options options = { .codegen = "dummy" };
+    struct options options = { .codegen = "dummy", .job_count = 1 };
 
     struct cli_option cli_options[] = {
         { .short_name = "-h", .long_name = "--help", .parse = usage },
         { .long_name = "--version", .parse = version },
         cli_option_string(NULL, "--codegen", &options.codegen),
+        cli_option_string(NULL, "--emit-bin", &options.binary_file),
         cli_flag(NULL, "--no-color",   &options.disable_colors),
         cli_flag(NULL, "--no-cleanup", &options.disable_cleanup),
-        cli_flag("-v", "--verbose",    &options.is_verbose)
+        cli_flag(NULL, "--stats",      &options.print_stats),
+        cli_flag("-v", "--verbose",    &options.is_verbose),
+        cli_option_uint32("-j", "--jobs", &options.job_count)
     };
     if (!cli_parse_options(argc, argv, cli_options, sizeof(cli_options) / sizeof(cli_options[0])))
         return 1;
 
-    bool status = true;
+    if (options.job_count == 0) {
+        fprintf(stderr, "invalid number of jobs\n");
+        return 1;
+    }
+
+    // Colors depend on where the output ends up, even when it is first written to memory.
+    options.disable_colors |= !is_term(stdout);
+
+    const char** file_names = malloc(sizeof(const char*) * argc);
     size_t file_count = 0;
     for (int i = 1; i < argc; ++i) {
-        if (!argv[i])
-            continue;
-        status &= compile_file(argv[i], &options);
-        file_count++;
+        if (argv[i])
+            file_names[file_count++] = argv[i];
     }
     if (file_count == 0) {
+        free(file_names);
         fprintf(stderr, "no input file\n");
         return 1;
     }
 
+    // Every input would otherwise be written to the same binary file, possibly at the same time.
+    if (options.binary_file && file_count > 1) {
+        free(file_names);
+        fprintf(stderr, "cannot write several modules to the same binary file\n");
+        return 1;
+    }
+
+    // Threads are used to print functions only when they are not already used to process files.
+    options.print_thread_count = file_count == 1 ? options.job_count : 1;
+
+    bool status = true;
+    if (options.job_count > 1 && file_count > 1) {
+        status = compile_files_in_parallel(file_names, file_count, &options);
+    } else {
+        for (size_t i = 0; i < file_count; ++i)
+            status &= compile_file(file_names[i], &options, stdout, stderr);
+    }
+
+    free(file_names);
     return status ? 0 : 1;
 }